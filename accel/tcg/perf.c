@@ -0,0 +1,266 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration.
+ *
+ * perf-<pid>.map is a plain text file that "perf report" and "perf top"
+ * use to name anonymous executable memory.  jit-<pid>.dump is the binary
+ * format understood by "perf inject --jit"; it additionally carries a
+ * copy of the generated code, so that samples can be annotated even
+ * after code_gen_buffer has been flushed and reused.
+ *
+ * Each translation block is described by its guest PC and, when the
+ * loader has provided symbol information, the guest symbol covering it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "disas/disas.h"
+#include "elf.h"
+#include "perf.h"
+
+static QemuMutex perf_lock;
+static bool perf_initialized;
+static FILE *perfmap;
+static FILE *jitdump;
+static void *jitdump_marker;
+static size_t jitdump_marker_size;
+static uint64_t jitdump_code_index;
+
+static void perf_init_lock(void)
+{
+    if (!perf_initialized) {
+        qemu_mutex_init(&perf_lock);
+        perf_initialized = true;
+    }
+}
+
+void perf_enable_perfmap(void)
+{
+    char map_file[32];
+
+    /* perf only ever looks in /tmp for map files. */
+    snprintf(map_file, sizeof(map_file), "/tmp/perf-%d.map", getpid());
+    perfmap = fopen(map_file, "w");
+    if (perfmap == NULL) {
+        warn_report("Could not open %s: %s, proceeding without perfmap",
+                    map_file, strerror(errno));
+        return;
+    }
+    perf_init_lock();
+}
+
+/* See tools/perf/Documentation/jitdump-specification.txt in Linux.  */
+
+#define JITHEADER_MAGIC 0x4A695444
+#define JITHEADER_VERSION 1
+
+struct jitheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+enum jit_record_type {
+    JIT_CODE_LOAD = 0,
+};
+
+struct jr_prefix {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+struct jr_code_load {
+    struct jr_prefix p;
+
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+/* perf matches jitdump records with samples using CLOCK_MONOTONIC.  */
+static uint64_t get_timestamp(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t get_e_machine(void)
+{
+    Elf64_Ehdr elf_header;
+    FILE *exe;
+    size_t n;
+
+    QEMU_BUILD_BUG_ON(offsetof(Elf32_Ehdr, e_machine) !=
+                      offsetof(Elf64_Ehdr, e_machine));
+
+    exe = fopen("/proc/self/exe", "r");
+    if (exe == NULL) {
+        return EM_NONE;
+    }
+
+    n = fread(&elf_header, sizeof(elf_header), 1, exe);
+    fclose(exe);
+    if (n != 1) {
+        return EM_NONE;
+    }
+
+    return elf_header.e_machine;
+}
+
+void perf_enable_jitdump(void)
+{
+    struct jitheader header;
+    char *dump_file;
+    int fd;
+
+    dump_file = g_strdup_printf("%s/jit-%d.dump", g_get_tmp_dir(), getpid());
+    fd = open(dump_file, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd == -1) {
+        warn_report("Could not open %s: %s, proceeding without jitdump",
+                    dump_file, strerror(errno));
+        g_free(dump_file);
+        return;
+    }
+
+    /*
+     * "perf record" saves mmaps of executable files, and "perf inject"
+     * finds the jitdump through that mmap.  The mapping itself is not
+     * used otherwise.
+     */
+    jitdump_marker_size = qemu_real_host_page_size;
+    jitdump_marker = mmap(NULL, jitdump_marker_size, PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE, fd, 0);
+    if (jitdump_marker == MAP_FAILED) {
+        warn_report("Could not map %s: %s, proceeding without jitdump",
+                    dump_file, strerror(errno));
+        close(fd);
+        g_free(dump_file);
+        return;
+    }
+    g_free(dump_file);
+
+    jitdump = fdopen(fd, "w+");
+
+    header.magic = JITHEADER_MAGIC;
+    header.version = JITHEADER_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = get_e_machine();
+    header.pad1 = 0;
+    header.pid = getpid();
+    header.timestamp = get_timestamp();
+    header.flags = 0;
+    fwrite(&header, sizeof(header), 1, jitdump);
+    fflush(jitdump);
+
+    perf_init_lock();
+}
+
+bool perf_enabled(void)
+{
+    return perfmap || jitdump;
+}
+
+static void write_perfmap_entry(const void *start, size_t size,
+                                const char *name)
+{
+    fprintf(perfmap, "%" PRIxPTR " %zx %s\n", (uintptr_t)start, size, name);
+    /* The guest may leave through exit_group() without running atexit.  */
+    fflush(perfmap);
+}
+
+static void write_jr_code_load(const void *start, size_t size,
+                               const char *name)
+{
+    struct jr_code_load load_event;
+    size_t name_len = strlen(name) + 1;
+
+    load_event.p.id = JIT_CODE_LOAD;
+    load_event.p.total_size = sizeof(load_event) + name_len + size;
+    load_event.p.timestamp = get_timestamp();
+    load_event.pid = getpid();
+    load_event.tid = qemu_get_thread_id();
+    load_event.vma = (uintptr_t)start;
+    load_event.code_addr = (uintptr_t)start;
+    load_event.code_size = size;
+    load_event.code_index = jitdump_code_index++;
+    fwrite(&load_event, sizeof(load_event), 1, jitdump);
+    fwrite(name, name_len, 1, jitdump);
+    fwrite(start, size, 1, jitdump);
+    fflush(jitdump);
+}
+
+static void perf_report(const void *start, size_t size, const char *name)
+{
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap) {
+        write_perfmap_entry(start, size, name);
+    }
+    if (jitdump) {
+        write_jr_code_load(start, size, name);
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+void perf_report_prologue(const void *start, size_t size)
+{
+    if (perf_enabled()) {
+        perf_report(start, size, "QEMU prologue and epilogue");
+    }
+}
+
+void perf_report_code(const TranslationBlock *tb)
+{
+    const char *symbol;
+    char *name;
+
+    if (!perf_enabled()) {
+        return;
+    }
+
+    symbol = lookup_symbol(tb->pc);
+    if (symbol[0] != '\0') {
+        name = g_strdup_printf("guest-0x" TARGET_FMT_lx " %s", tb->pc, symbol);
+    } else {
+        name = g_strdup_printf("guest-0x" TARGET_FMT_lx, tb->pc);
+    }
+    perf_report(tb->tc.ptr, tb->tc.size, name);
+    g_free(name);
+}
+
+void perf_exit(void)
+{
+    if (!perf_enabled()) {
+        return;
+    }
+
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+    if (jitdump) {
+        munmap(jitdump_marker, jitdump_marker_size);
+        fclose(jitdump);
+        jitdump = NULL;
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
@@ -0,0 +1,30 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef ACCEL_TCG_PERF_H
+#define ACCEL_TCG_PERF_H
+
+struct TranslationBlock;
+
+/* Start writing perf-<pid>.map. */
+void perf_enable_perfmap(void);
+
+/* Start writing jit-<pid>.dump. */
+void perf_enable_jitdump(void);
+
+/* Return true if either of the above is active. */
+bool perf_enabled(void);
+
+/* Add the prologue and epilogue to perf-<pid>.map and jit-<pid>.dump. */
+void perf_report_prologue(const void *start, size_t size);
+
+/* Add information about a freshly translated TB to the enabled outputs. */
+void perf_report_code(const struct TranslationBlock *tb);
+
+/* Stop writing perf-<pid>.map and jit-<pid>.dump. */
+void perf_exit(void);
+
+#endif /* ACCEL_TCG_PERF_H */
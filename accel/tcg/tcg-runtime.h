@@ -28,6 +28,10 @@ DEF_HELPER_FLAGS_1(lookup_tb_ptr, TCG_CALL_NO_WG_SE, ptr, env)
 
 DEF_HELPER_FLAGS_1(exit_atomic, TCG_CALL_NO_WG, noreturn, env)
 
+#ifdef CONFIG_USER_ONLY
+DEF_HELPER_FLAGS_4(vdso_call, TCG_CALL_NO_WG, tl, env, i32, tl, tl)
+#endif
+
 #ifdef CONFIG_SOFTMMU
 
 DEF_HELPER_FLAGS_5(atomic_cmpxchgb, TCG_CALL_NO_WG,
@@ -47,16 +47,20 @@
 #endif
 #else
 #include "exec/address-spaces.h"
+#include "qapi/error.h"
+#include "qmp-commands.h"
 #endif
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
 #include "translate-all.h"
+#include "perf.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
 #include "exec/log.h"
+#include "exec/translator.h"
 #include "sysemu/cpus.h"
 
 /* #define DEBUG_TB_INVALIDATE */
@@ -87,14 +91,26 @@
 #define DEBUG_TB_CHECK_GATE 0
 #endif
 
-/* Access to the various translations structures need to be serialised via locks
- * for consistency. This is automatic for SoftMMU based system
- * emulation due to its single threaded nature. In user-mode emulation
- * access to the memory related structures are protected with the
- * mmap_lock.
+/*
+ * Translation does not take a global lock.  Instead:
+ *
+ * - Each PageDesc has a lock that protects its list of TBs and its code
+ *   bitmap.  A TB that spans two pages is added to and removed from both
+ *   lists with both page locks held; they are always acquired in
+ *   increasing order of page index.
+ * - tb_ctx.htable is a QHT, which handles concurrent insertions and
+ *   removals by itself.  Two threads may translate the same code at
+ *   once; the loser of the qht insertion discards its translation.
+ * - The lists of incoming jumps are protected by each TB's jmp_lock.
+ * - The binary search trees keyed on the host code address are owned by
+ *   tcg.c, see tcg_tb_insert().
+ *
+ * In user-mode emulation the mmap_lock is held during translation and
+ * is needed anyway for page flags and mprotect, so it protects the
+ * PageDescs as well and the page locks are no-ops.
  */
 #ifdef CONFIG_SOFTMMU
-#define assert_memory_lock() tcg_debug_assert(have_tb_lock)
+#define assert_memory_lock()
 #else
 #define assert_memory_lock() tcg_debug_assert(have_mmap_lock())
 #endif
@@ -109,11 +125,25 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned int code_write_count;
     unsigned long *code_bitmap;
-#else
-    unsigned long flags;
+    QemuSpin lock;
 #endif
 } PageDesc;
 
+/* Iterate the TB list of a page; @n is the index of the page in @tb */
+#define PAGE_FOR_EACH_TB(pagedesc, tb, n)                               \
+    for (n = (uintptr_t)(pagedesc)->first_tb & 1,                       \
+         tb = (TranslationBlock *)((uintptr_t)(pagedesc)->first_tb & ~1); \
+         tb; tb = tb->page_next[n], n = (uintptr_t)tb & 1,              \
+         tb = (TranslationBlock *)((uintptr_t)tb & ~1))
+
+/* Iterate the TBs that jump to @head_tb; @n is the jump index in @tb */
+#define TB_FOR_EACH_JMP(head_tb, tb, n)                                 \
+    for (n = (head_tb)->jmp_list_head & 1,                              \
+         tb = (TranslationBlock *)((head_tb)->jmp_list_head & ~1);      \
+         tb; tb = (TranslationBlock *)tb->jmp_list_next[n],             \
+         n = (uintptr_t)tb & 1,                                         \
+         tb = (TranslationBlock *)((uintptr_t)tb & ~1))
+
 /* In system mode we want L1_MAP to be based on ram offsets,
    while in user mode we want it to be based on virtual addresses.  */
 #if !defined(CONFIG_USER_ONLY)
@@ -157,9 +187,6 @@ __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
 
-/* translation block context */
-static __thread int have_tb_lock;
-
 static void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -180,33 +207,6 @@ static void page_table_config_init(void)
     assert(v_l2_levels >= 0);
 }
 
-#define assert_tb_locked() tcg_debug_assert(have_tb_lock)
-#define assert_tb_unlocked() tcg_debug_assert(!have_tb_lock)
-
-void tb_lock(void)
-{
-    assert_tb_unlocked();
-    qemu_mutex_lock(&tb_ctx.tb_lock);
-    have_tb_lock++;
-}
-
-void tb_unlock(void)
-{
-    assert_tb_locked();
-    have_tb_lock--;
-    qemu_mutex_unlock(&tb_ctx.tb_lock);
-}
-
-void tb_lock_reset(void)
-{
-    if (have_tb_lock) {
-        qemu_mutex_unlock(&tb_ctx.tb_lock);
-        have_tb_lock = 0;
-    }
-}
-
-static TranslationBlock *tb_find_pc(uintptr_t tc_ptr);
-
 void cpu_gen_init(void)
 {
     tcg_context_init(&tcg_init_ctx);
@@ -253,6 +253,22 @@ static target_long decode_sleb128(uint8_t **pp)
     return val;
 }
 
+/* Every TB_SEARCH_CHECKPOINT_INSNS insns, the search data restarts from
+   the seed for the first line, and a checkpoint records where that line
+   is and the host pc at which its insn begins.  This allows the search
+   to skip straight to the last checkpoint preceding the host pc.  */
+#define TB_SEARCH_CHECKPOINT_INSNS  16
+
+typedef struct TBSearchCheckpoint {
+    uint16_t host_off;      /* offset of the insn's code from tb->tc.ptr */
+    uint16_t data_off;      /* offset of the insn's line in the encoding */
+} TBSearchCheckpoint;
+
+static inline int tb_search_nb_checkpoints(int icount)
+{
+    return icount ? (icount - 1) / TB_SEARCH_CHECKPOINT_INSNS : 0;
+}
+
 /* Encode the data collected about the instructions while compiling TB.
    Place the data at BLOCK, and return the number of bytes consumed.
 
@@ -263,19 +279,37 @@ static target_long decode_sleb128(uint8_t **pp)
    Each line of the table is encoded as sleb128 deltas from the previous
    line.  The seed for the first line is { tb->pc, 0..., tb->tc.ptr }.
    That is, the first column is seeded with the guest pc, the last column
-   with the host pc, and the middle columns with zeros.  */
+   with the host pc, and the middle columns with zeros.  The target columns
+   are seeded the same way again at every checkpoint line.
+
+   The encoded lines are preceded by the (aligned) array of checkpoints,
+   whose length follows from tb->icount.  */
 
 static int encode_search(TranslationBlock *tb, uint8_t *block)
 {
     uint8_t *highwater = tcg_ctx->code_gen_highwater;
-    uint8_t *p = block;
+    TBSearchCheckpoint *cp = (TBSearchCheckpoint *)
+        QEMU_ALIGN_PTR_UP(block, sizeof(TBSearchCheckpoint));
+    uint8_t *start = (uint8_t *)(cp + tb_search_nb_checkpoints(tb->icount));
+    uint8_t *p = start;
     int i, j, n;
 
+    if (unlikely(start > highwater)) {
+        return -1;
+    }
+
     for (i = 0, n = tb->icount; i < n; ++i) {
+        bool reseed = (i % TB_SEARCH_CHECKPOINT_INSNS == 0);
         target_ulong prev;
 
+        if (reseed && i != 0) {
+            tcg_debug_assert(p - start <= UINT16_MAX);
+            cp->host_off = tcg_ctx->gen_insn_end_off[i - 1];
+            cp->data_off = p - start;
+            cp++;
+        }
         for (j = 0; j < TARGET_INSN_START_WORDS; ++j) {
-            if (i == 0) {
+            if (reseed) {
                 prev = (j == 0 ? tb->pc : 0);
             } else {
                 prev = tcg_ctx->gen_insn_data[i - 1][j];
@@ -298,7 +332,6 @@ static int encode_search(TranslationBlock *tb, uint8_t *block)
 }
 
 /* The cpu state corresponding to 'searched_pc' is restored.
- * Called with tb_lock held.
  */
 static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                      uintptr_t searched_pc)
@@ -306,8 +339,9 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
     target_ulong data[TARGET_INSN_START_WORDS] = { tb->pc };
     uintptr_t host_pc = (uintptr_t)tb->tc.ptr;
     CPUArchState *env = cpu->env_ptr;
-    uint8_t *p = tb->tc.ptr + tb->tc.size;
-    int i, j, num_insns = tb->icount;
+    const TBSearchCheckpoint *cp;
+    uint8_t *p;
+    int i, j, lo, hi, num_insns = tb->icount;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti = profile_getclock();
@@ -319,9 +353,32 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
         return -1;
     }
 
+    /* Find the last checkpoint whose insn begins at or before searched_pc,
+       and start decoding from there.  */
+    cp = QEMU_ALIGN_PTR_UP(tb->tc.ptr + tb->tc.size,
+                           sizeof(TBSearchCheckpoint));
+    lo = 0;
+    hi = tb_search_nb_checkpoints(num_insns);
+    p = (uint8_t *)(cp + hi);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (host_pc + cp[mid].host_off <= searched_pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    i = 0;
+    if (lo > 0) {
+        i = lo * TB_SEARCH_CHECKPOINT_INSNS;
+        p += cp[lo - 1].data_off;
+        host_pc += cp[lo - 1].host_off;
+    }
+
     /* Reconstruct the stored insn data while looking for the point at
        which the end of the insn exceeds the searched_pc.  */
-    for (i = 0; i < num_insns; ++i) {
+    for (; i < num_insns; ++i) {
         for (j = 0; j < TARGET_INSN_START_WORDS; ++j) {
             data[j] += decode_sleb128(&p);
         }
@@ -364,8 +421,7 @@ bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc)
      *  - fault during translation (instruction fetch)
      *  - fault from helper (not using GETPC() macro)
      *
-     * Either way we need return early to avoid blowing up on a
-     * recursive tb_lock() as we can't resolve it here.
+     * Either way we need return early as we can't resolve it here.
      *
      * We are using unsigned arithmetic so if host_pc <
      * tcg_init_ctx.code_gen_buffer check_offset will wrap to way
@@ -374,27 +430,196 @@ bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc)
     check_offset = host_pc - (uintptr_t) tcg_init_ctx.code_gen_buffer;
 
     if (check_offset < tcg_init_ctx.code_gen_buffer_size) {
-        tb_lock();
-        tb = tb_find_pc(host_pc);
+        tb = tcg_tb_lookup(host_pc);
         if (tb) {
             cpu_restore_state_from_tb(cpu, tb, host_pc);
             if (tb->cflags & CF_NOCACHE) {
                 /* one-shot translation, invalidate it immediately */
                 tb_phys_invalidate(tb, -1);
-                tb_remove(tb);
+                tcg_tb_remove(tb);
             }
             r = true;
         }
-        tb_unlock();
     }
 
     return r;
 }
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * The flags of the guest pages are kept as a balanced tree of disjoint
+ * ranges, so that updating, looking up and walking them costs time in
+ * the number of mappings rather than in the number of pages.  Ranges
+ * never have zero flags, and adjacent ranges with the same flags are
+ * always merged.
+ *
+ * Updates are made with the mmap_lock held; page_flags_lock in addition
+ * lets page_get_flags and page_check_range run without it.  It is the
+ * innermost lock: nothing else is taken or called while holding it.
+ */
+typedef struct PageFlagsRange {
+    target_ulong start;
+    target_ulong last;          /* inclusive */
+    int flags;
+} PageFlagsRange;
+
+static GSequence *page_flags_map;
+static QemuMutex page_flags_lock;
+
+/* Ranges are ordered by address.  The search key for an address is a
+ * range without flags, which sorts just before the range holding it.
+ */
+static gint page_flags_cmp(gconstpointer a, gconstpointer b, gpointer opaque)
+{
+    const PageFlagsRange *ra = a, *rb = b;
+
+    if (ra->flags == 0) {
+        return ra->start <= rb->last ? -1 : 1;
+    }
+    if (rb->flags == 0) {
+        return rb->start <= ra->last ? 1 : -1;
+    }
+    return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+/* Return the first range that ends at or after @addr.  */
+static GSequenceIter *page_flags_find(target_ulong addr)
+{
+    PageFlagsRange key = { .start = addr, .last = addr };
+
+    return g_sequence_search(page_flags_map, &key, page_flags_cmp, NULL);
+}
+
+static inline PageFlagsRange *page_flags_range(GSequenceIter *it)
+{
+    return g_sequence_iter_is_end(it) ? NULL : g_sequence_get(it);
+}
+
+static int page_flags_lookup(target_ulong addr)
+{
+    PageFlagsRange *r = page_flags_range(page_flags_find(addr));
+
+    return r && r->start <= addr ? r->flags : 0;
+}
+
+/* Return the union of the flags in [@start, @last].  */
+static int page_flags_union(target_ulong start, target_ulong last)
+{
+    GSequenceIter *it;
+    PageFlagsRange *r;
+    int flags = 0;
+
+    for (it = page_flags_find(start);
+         (r = page_flags_range(it)) && r->start <= last;
+         it = g_sequence_iter_next(it)) {
+        flags |= r->flags;
+    }
+    return flags;
+}
+
+static void page_flags_push(PageFlagsRange *r, size_t *n,
+                            target_ulong start, target_ulong last, int flags)
+{
+    if (flags == 0) {
+        return;
+    }
+    if (*n && r[*n - 1].flags == flags && r[*n - 1].last + 1 == start) {
+        r[*n - 1].last = last;
+        return;
+    }
+    r[*n].start = start;
+    r[*n].last = last;
+    r[*n].flags = flags;
+    (*n)++;
+}
+
+/* Replace the flags of the mapped pages in [@start, @last] with
+ * (flags & ~@clear) | @set.  If @fill, the unmapped pages in the
+ * range get @set as well.  Called with page_flags_lock held.
+ */
+static void page_flags_modify(target_ulong start, target_ulong last,
+                              int clear, int set, bool fill)
+{
+    GSequenceIter *first, *it, *end;
+    PageFlagsRange *r, *new;
+    target_ulong addr = start;
+    bool done = false;
+    size_t i, n = 0, old = 0;
+
+    /* Take in the neighbours that touch the range, to merge with them.  */
+    it = page_flags_find(start);
+    if (!g_sequence_iter_is_begin(it)) {
+        GSequenceIter *prev = g_sequence_iter_prev(it);
+
+        r = g_sequence_get(prev);
+        if (r->last + 1 == start) {
+            it = prev;
+        }
+    }
+    for (end = it;
+         (r = page_flags_range(end)) && (r->start <= last ||
+                                          r->start - 1 == last);
+         end = g_sequence_iter_next(end)) {
+        old++;
+    }
+
+    new = g_new(PageFlagsRange, 2 * old + 3);
+    for (first = it; it != end; it = g_sequence_iter_next(it)) {
+        r = g_sequence_get(it);
+        if (r->start < start) {
+            page_flags_push(new, &n, r->start, MIN(r->last, start - 1),
+                            r->flags);
+        }
+        if (fill && !done && r->start > addr) {
+            target_ulong l = MIN(r->start - 1, last);
+
+            page_flags_push(new, &n, addr, l, set);
+            addr = l + 1;
+            done = l == last;
+        }
+        if (r->last >= start && r->start <= last) {
+            target_ulong s = MAX(r->start, start);
+            target_ulong l = MIN(r->last, last);
+
+            page_flags_push(new, &n, s, l, (r->flags & ~clear) | set);
+            addr = l + 1;
+            done = l == last;
+        }
+        if (r->last > last) {
+            page_flags_push(new, &n, MAX(r->start, last + 1), r->last,
+                            r->flags);
+        }
+    }
+    if (fill && !done) {
+        page_flags_push(new, &n, addr, last, set);
+    }
+
+    /* Reuse the old entries in place, then remove or add the difference.  */
+    for (i = 0, it = first; it != end && i < n; i++) {
+        *(PageFlagsRange *)g_sequence_get(it) = new[i];
+        it = g_sequence_iter_next(it);
+    }
+    while (it != end) {
+        GSequenceIter *cur = it;
+
+        it = g_sequence_iter_next(cur);
+        g_sequence_remove(cur);
+    }
+    for (; i < n; i++) {
+        g_sequence_insert_before(end, g_memdup(&new[i], sizeof(*new)));
+    }
+    g_free(new);
+}
+#endif
+
 static void page_init(void)
 {
     page_size_init();
     page_table_config_init();
+#ifdef CONFIG_USER_ONLY
+    page_flags_map = g_sequence_new(g_free);
+    qemu_mutex_init(&page_flags_lock);
+#endif
 
 #if defined(CONFIG_BSD) && defined(CONFIG_USER_ONLY)
     {
@@ -463,8 +688,9 @@ static void page_init(void)
 }
 
 /* If alloc=1:
- * Called with tb_lock held for system emulation.
  * Called with mmap_lock held for user-mode emulation.
+ * In system emulation several threads may allocate concurrently; the
+ * tables are installed with cmpxchg and the losers free their copy.
  */
 static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
 {
@@ -484,11 +710,17 @@ static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
         void **p = atomic_rcu_read(lp);
 
         if (p == NULL) {
+            void *existing;
+
             if (!alloc) {
                 return NULL;
             }
             p = g_new0(void *, V_L2_SIZE);
-            atomic_rcu_set(lp, p);
+            existing = atomic_cmpxchg(lp, NULL, p);
+            if (unlikely(existing)) {
+                g_free(p);
+                p = existing;
+            }
         }
 
         lp = p + ((index >> (i * V_L2_BITS)) & (V_L2_SIZE - 1));
@@ -496,11 +728,22 @@ static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
 
     pd = atomic_rcu_read(lp);
     if (pd == NULL) {
+        void *existing;
+
         if (!alloc) {
             return NULL;
         }
         pd = g_new0(PageDesc, V_L2_SIZE);
-        atomic_rcu_set(lp, pd);
+#ifdef CONFIG_SOFTMMU
+        for (i = 0; i < V_L2_SIZE; i++) {
+            qemu_spin_init(&pd[i].lock);
+        }
+#endif
+        existing = atomic_cmpxchg(lp, NULL, pd);
+        if (unlikely(existing)) {
+            g_free(pd);
+            pd = existing;
+        }
     }
 
     return pd + (index & (V_L2_SIZE - 1));
@@ -511,6 +754,131 @@ static inline PageDesc *page_find(tb_page_addr_t index)
     return page_find_alloc(index, 0);
 }
 
+/* Return the first page in [@index, @last] that has a PageDesc, or a
+ * value above @last if there is none.  The parts of the table that were
+ * never allocated are skipped as a whole.
+ */
+static tb_page_addr_t page_find_next(tb_page_addr_t index,
+                                     tb_page_addr_t last)
+{
+    while (index <= last) {
+        tb_page_addr_t span = (tb_page_addr_t)1 << v_l1_shift;
+        void **lp = l1_map + ((index >> v_l1_shift) & (v_l1_size - 1));
+        int i;
+
+        for (i = v_l2_levels; i > 0; i--) {
+            void **p = atomic_rcu_read(lp);
+
+            if (p == NULL) {
+                break;
+            }
+            lp = p + ((index >> (i * V_L2_BITS)) & (V_L2_SIZE - 1));
+            span = (tb_page_addr_t)1 << (i * V_L2_BITS);
+        }
+        if (atomic_rcu_read(lp)) {
+            return index;
+        }
+        index = (index | (span - 1)) + 1;
+    }
+    return index;
+}
+
+#ifdef CONFIG_SOFTMMU
+static inline void page_lock(PageDesc *pd)
+{
+    qemu_spin_lock(&pd->lock);
+}
+
+static inline void page_unlock(PageDesc *pd)
+{
+    qemu_spin_unlock(&pd->lock);
+}
+
+/* Try to lock @pd; returns true on success.  */
+static inline bool page_trylock(PageDesc *pd)
+{
+    return !qemu_spin_trylock(&pd->lock);
+}
+#else
+/* The mmap_lock protects the PageDescs in user-mode.  */
+static inline void page_lock(PageDesc *pd)
+{
+}
+
+static inline void page_unlock(PageDesc *pd)
+{
+}
+
+static inline bool page_trylock(PageDesc *pd)
+{
+    return true;
+}
+#endif
+
+/*
+ * Lock the PageDescs of the pages at @phys1 and @phys2 (or only the
+ * former if @phys2 is -1) in increasing page order, and return them in
+ * *@ret_p1 and *@ret_p2.  If both addresses are in the same page, it is
+ * locked once and *@ret_p2 equals *@ret_p1.  With @alloc, missing
+ * PageDescs are allocated; otherwise a missing PageDesc is returned as
+ * NULL and not locked.
+ */
+static void page_lock_pair(PageDesc **ret_p1, tb_page_addr_t phys1,
+                           PageDesc **ret_p2, tb_page_addr_t phys2, int alloc)
+{
+    PageDesc *p1, *p2;
+    tb_page_addr_t page1;
+    tb_page_addr_t page2;
+
+    assert_memory_lock();
+    g_assert(phys1 != -1);
+
+    page1 = phys1 >> TARGET_PAGE_BITS;
+    page2 = phys2 >> TARGET_PAGE_BITS;
+
+    p1 = page_find_alloc(page1, alloc);
+    *ret_p1 = p1;
+    if (likely(phys2 == -1)) {
+        *ret_p2 = NULL;
+        if (p1) {
+            page_lock(p1);
+        }
+        return;
+    } else if (page1 == page2) {
+        *ret_p2 = p1;
+        if (p1) {
+            page_lock(p1);
+        }
+        return;
+    }
+    p2 = page_find_alloc(page2, alloc);
+    *ret_p2 = p2;
+    if (p1 && p2) {
+        if (page1 < page2) {
+            page_lock(p1);
+            page_lock(p2);
+        } else {
+            page_lock(p2);
+            page_lock(p1);
+        }
+    } else if (p1) {
+        page_lock(p1);
+    } else if (p2) {
+        page_lock(p2);
+    }
+}
+
+/* Unlock the pages locked by page_lock_pair().  */
+static void page_unlock_pair(PageDesc *p1, PageDesc *p2)
+{
+    if (p2 && p2 != p1) {
+        page_unlock(p2);
+    }
+    if (p1) {
+        page_unlock(p1);
+    }
+}
+
 #if defined(CONFIG_USER_ONLY)
 /* Currently it is not recommended to allocate big chunks of data in
    user mode. It will change when a dedicated libc will be used.  */
@@ -731,48 +1099,6 @@ static inline void *alloc_code_gen_buffer(void)
 }
 #endif /* USE_STATIC_CODE_GEN_BUFFER, WIN32, POSIX */
 
-/* compare a pointer @ptr and a tb_tc @s */
-static int ptr_cmp_tb_tc(const void *ptr, const struct tb_tc *s)
-{
-    if (ptr >= s->ptr + s->size) {
-        return 1;
-    } else if (ptr < s->ptr) {
-        return -1;
-    }
-    return 0;
-}
-
-static gint tb_tc_cmp(gconstpointer ap, gconstpointer bp)
-{
-    const struct tb_tc *a = ap;
-    const struct tb_tc *b = bp;
-
-    /*
-     * When both sizes are set, we know this isn't a lookup.
-     * This is the most likely case: every TB must be inserted; lookups
-     * are a lot less frequent.
-     */
-    if (likely(a->size && b->size)) {
-        if (a->ptr > b->ptr) {
-            return 1;
-        } else if (a->ptr < b->ptr) {
-            return -1;
-        }
-        /* a->ptr == b->ptr should happen only on deletions */
-        g_assert(a->size == b->size);
-        return 0;
-    }
-    /*
-     * All lookups have either .size field set to 0.
-     * From the glib sources we see that @ap is always the lookup key. However
-     * the docs provide no guarantee, so we just mark this case as likely.
-     */
-    if (likely(a->size == 0)) {
-        return ptr_cmp_tb_tc(a->ptr, b);
-    }
-    return ptr_cmp_tb_tc(b->ptr, a);
-}
-
 static inline void code_gen_alloc(size_t tb_size)
 {
     tcg_ctx->code_gen_buffer_size = size_code_gen_buffer(tb_size);
@@ -781,15 +1107,32 @@ static inline void code_gen_alloc(size_t tb_size)
         fprintf(stderr, "Could not allocate dynamic translator buffer\n");
         exit(1);
     }
-    tb_ctx.tb_tree = g_tree_new(tb_tc_cmp);
-    qemu_mutex_init(&tb_ctx.tb_lock);
+}
+
+/*
+ * Two TBs are equivalent if a lookup for one of them could return the
+ * other; tb_link_page() relies on this to detect concurrent translations
+ * of the same code.
+ */
+static bool tb_cmp(const void *ap, const void *bp)
+{
+    const TranslationBlock *a = ap;
+    const TranslationBlock *b = bp;
+
+    return a->pc == b->pc &&
+        a->cs_base == b->cs_base &&
+        a->flags == b->flags &&
+        (tb_cflags(a) & CF_HASH_MASK) == (tb_cflags(b) & CF_HASH_MASK) &&
+        a->trace_vcpu_dstate == b->trace_vcpu_dstate &&
+        a->page_addr[0] == b->page_addr[0] &&
+        a->page_addr[1] == b->page_addr[1];
 }
 
 static void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
-    qht_init(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE, mode);
+    qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -812,15 +1155,11 @@ void tcg_exec_init(unsigned long tb_size)
 /*
  * Allocate a new translation block. Flush the translation buffer if
  * too many translation blocks or too much generated code.
- *
- * Called with tb_lock held.
  */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
     TranslationBlock *tb;
 
-    assert_tb_locked();
-
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(tb == NULL)) {
         return NULL;
@@ -828,14 +1167,7 @@ static TranslationBlock *tb_alloc(target_ulong pc)
     return tb;
 }
 
-/* Called with tb_lock held.  */
-void tb_remove(TranslationBlock *tb)
-{
-    assert_tb_locked();
-
-    g_tree_remove(tb_ctx.tb_tree, &tb->tc);
-}
-
+/* Call with the page locked.  */
 static inline void invalidate_page_bitmap(PageDesc *p)
 {
 #ifdef CONFIG_SOFTMMU
@@ -857,8 +1189,10 @@ static void page_flush_tb_1(int level, void **lp)
         PageDesc *pd = *lp;
 
         for (i = 0; i < V_L2_SIZE; ++i) {
+            page_lock(&pd[i]);
             pd[i].first_tb = NULL;
             invalidate_page_bitmap(pd + i);
+            page_unlock(&pd[i]);
         }
     } else {
         void **pp = *lp;
@@ -890,7 +1224,7 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
-    tb_lock();
+    mmap_lock();
 
     /* If it is already been done on request of another CPU,
      * just retry.
@@ -900,10 +1234,10 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     }
 
     if (DEBUG_TB_FLUSH_GATE) {
-        size_t nb_tbs = g_tree_nnodes(tb_ctx.tb_tree);
+        size_t nb_tbs = tcg_nb_tbs();
         size_t host_size = 0;
 
-        g_tree_foreach(tb_ctx.tb_tree, tb_host_size_iter, &host_size);
+        tcg_tb_foreach(tb_host_size_iter, &host_size);
         printf("qemu: flush code_size=%zu nb_tbs=%zu avg_tb_size=%zu\n",
                tcg_code_size(), nb_tbs, nb_tbs > 0 ? host_size / nb_tbs : 0);
     }
@@ -912,20 +1246,17 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         cpu_tb_jmp_cache_clear(cpu);
     }
 
-    /* Increment the refcount first so that destroy acts as a reset */
-    g_tree_ref(tb_ctx.tb_tree);
-    g_tree_destroy(tb_ctx.tb_tree);
-
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
 
+    /* also resets the TB trees */
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
 
 done:
-    tb_unlock();
+    mmap_unlock();
 }
 
 void tb_flush(CPUState *cpu)
@@ -937,6 +1268,91 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_collect_iter(gpointer key, gpointer value, gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Free one region of code_gen_buffer.  The TBs in it are unlinked from
+ * the hash table, the page lists and the jump lists as if they had been
+ * invalidated, and then removed from the region trees.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_evict_count)
+{
+    void *start, *end;
+    GPtrArray *tbs;
+    size_t i;
+
+    mmap_lock();
+
+    /* If it is already been done on request of another CPU,
+     * just retry.
+     */
+    if (tb_ctx.tb_evict_count != tb_evict_count.host_int) {
+        goto done;
+    }
+
+    /*
+     * The TBs in tb_jmp_cache are those that ran most recently, in
+     * particular since the last eviction cleared the caches.  Let them
+     * keep their regions alive.
+     */
+    CPU_FOREACH(cpu) {
+        for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+            TranslationBlock *tb = atomic_read(&cpu->tb_jmp_cache[i]);
+
+            if (tb) {
+                tcg_region_note_use(tb);
+            }
+        }
+    }
+
+    if (!tcg_region_evict(&start, &end)) {
+        /* Every region is in use by a TCG context; fall back to a flush.  */
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_ctx.tb_flush_count));
+        goto evicted;
+    }
+
+    tbs = g_ptr_array_new();
+    tcg_region_tb_foreach(start, tb_collect_iter, tbs);
+    for (i = 0; i < tbs->len; i++) {
+        TranslationBlock *tb = g_ptr_array_index(tbs, i);
+
+        tb_phys_invalidate(tb, -1);
+        tcg_tb_remove(tb);
+    }
+    if (DEBUG_TB_FLUSH_GATE) {
+        printf("qemu: evict region %p-%p nb_tbs=%u\n", start, end, tbs->len);
+    }
+    g_ptr_array_free(tbs, true);
+
+    /* Stale entries could otherwise point into the recycled region.  */
+    CPU_FOREACH(cpu) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
+evicted:
+    atomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+
+done:
+    mmap_unlock();
+}
+
+/*
+ * Like tb_flush, but only discard the translations in one region of
+ * code_gen_buffer, keeping the most recently used ones where possible.
+ * Requires eviction mode (see tcg_region_set_evict).
+ */
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_evict_count = atomic_mb_read(&tb_ctx.tb_evict_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_evict,
+                          RUN_ON_CPU_HOST_INT(tb_evict_count));
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -959,7 +1375,7 @@ do_tb_invalidate_check(struct qht *ht, void *p, uint32_t hash, void *userp)
 
 /* verify that all the pages have correct rights for code
  *
- * Called with tb_lock held.
+ * Called with mmap_lock held.
  */
 static void tb_invalidate_check(target_ulong address)
 {
@@ -989,51 +1405,71 @@ static void tb_page_check(void)
 
 #endif /* CONFIG_USER_ONLY */
 
-static inline void tb_page_remove(TranslationBlock **ptb, TranslationBlock *tb)
+/* Call with the page locked.  */
+static inline void tb_page_remove(PageDesc *pd, TranslationBlock *tb)
 {
     TranslationBlock *tb1;
+    TranslationBlock **pprev;
     unsigned int n1;
 
-    for (;;) {
-        tb1 = *ptb;
-        n1 = (uintptr_t)tb1 & 3;
-        tb1 = (TranslationBlock *)((uintptr_t)tb1 & ~3);
+    pprev = &pd->first_tb;
+    PAGE_FOR_EACH_TB(pd, tb1, n1) {
         if (tb1 == tb) {
-            *ptb = tb1->page_next[n1];
-            break;
+            *pprev = tb1->page_next[n1];
+            return;
         }
-        ptb = &tb1->page_next[n1];
+        pprev = &tb1->page_next[n1];
     }
+    g_assert_not_reached();
 }
 
-/* remove the TB from a list of TBs jumping to the n-th jump target of the TB */
-static inline void tb_remove_from_jmp_list(TranslationBlock *tb, int n)
+/* remove @orig from its @n_orig-th jump list */
+static inline void tb_remove_from_jmp_list(TranslationBlock *orig, int n_orig)
 {
-    TranslationBlock *tb1;
-    uintptr_t *ptb, ntb;
-    unsigned int n1;
+    uintptr_t ptr, ptr_locked;
+    TranslationBlock *dest;
+    TranslationBlock *tb;
+    uintptr_t *pprev;
+    int n;
 
-    ptb = &tb->jmp_list_next[n];
-    if (*ptb) {
-        /* find tb(n) in circular list */
-        for (;;) {
-            ntb = *ptb;
-            n1 = ntb & 3;
-            tb1 = (TranslationBlock *)(ntb & ~3);
-            if (n1 == n && tb1 == tb) {
-                break;
-            }
-            if (n1 == 2) {
-                ptb = &tb1->jmp_list_first;
-            } else {
-                ptb = &tb1->jmp_list_next[n1];
-            }
-        }
-        /* now we can suppress tb(n) from the list */
-        *ptb = tb->jmp_list_next[n];
+    /* mark the LSB of jmp_dest[] so that no further jumps can be inserted */
+    ptr = atomic_or_fetch(&orig->jmp_dest[n_orig], 1);
+    dest = (TranslationBlock *)(ptr & ~1);
+    if (dest == NULL) {
+        return;
+    }
 
-        tb->jmp_list_next[n] = (uintptr_t)NULL;
+    qemu_spin_lock(&dest->jmp_lock);
+    /*
+     * While acquiring the lock, the jump might have been removed if the
+     * destination TB was invalidated; check again.
+     */
+    ptr_locked = atomic_read(&orig->jmp_dest[n_orig]);
+    if (ptr_locked != ptr) {
+        qemu_spin_unlock(&dest->jmp_lock);
+        /*
+         * The only possibility is that the jump was unlinked via
+         * tb_jmp_unlink(dest). Seeing here another destination would be a
+         * bug, because we set the LSB above.
+         */
+        g_assert(ptr_locked == 1 && dest->cflags & CF_INVALID);
+        return;
+    }
+    /*
+     * We first acquired the lock, and since the destination pointer matches,
+     * we know for sure that @orig is in the jmp list.
+     */
+    pprev = &dest->jmp_list_head;
+    TB_FOR_EACH_JMP(dest, tb, n) {
+        if (tb == orig && n == n_orig) {
+            *pprev = tb->jmp_list_next[n];
+            /* no need to set orig->jmp_dest[n]; setting the LSB was enough */
+            qemu_spin_unlock(&dest->jmp_lock);
+            return;
+        }
+        pprev = &tb->jmp_list_next[n];
     }
+    g_assert_not_reached();
 }
 
 /* reset the jump entry 'n' of a TB so that it is not chained to
@@ -1045,40 +1481,44 @@ static inline void tb_reset_jump(TranslationBlock *tb, int n)
 }
 
 /* remove any jumps to the TB */
-static inline void tb_jmp_unlink(TranslationBlock *tb)
+static inline void tb_jmp_unlink(TranslationBlock *dest)
 {
-    TranslationBlock *tb1;
-    uintptr_t *ptb, ntb;
-    unsigned int n1;
+    TranslationBlock *tb;
+    int n;
 
-    ptb = &tb->jmp_list_first;
-    for (;;) {
-        ntb = *ptb;
-        n1 = ntb & 3;
-        tb1 = (TranslationBlock *)(ntb & ~3);
-        if (n1 == 2) {
-            break;
-        }
-        tb_reset_jump(tb1, n1);
-        *ptb = tb1->jmp_list_next[n1];
-        tb1->jmp_list_next[n1] = (uintptr_t)NULL;
+    qemu_spin_lock(&dest->jmp_lock);
+
+    TB_FOR_EACH_JMP(dest, tb, n) {
+        tb_reset_jump(tb, n);
+        atomic_and(&tb->jmp_dest[n], (uintptr_t)NULL | 1);
+        /* No need to clear the list entry; setting the dest ptr is enough */
     }
+    dest->jmp_list_head = (uintptr_t)NULL;
+
+    qemu_spin_unlock(&dest->jmp_lock);
 }
 
-/* invalidate one TB
+/*
+ * Remove @tb from the page lists, except that of the page at @page_addr,
+ * which the caller is about to clear.
  *
- * Called with tb_lock held.
+ * In user-mode, call with mmap_lock held.
+ * In !user-mode, call with the TB's pages' locks held.
  */
-void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
+static void do_tb_phys_invalidate(TranslationBlock *tb,
+                                  tb_page_addr_t page_addr)
 {
     CPUState *cpu;
     PageDesc *p;
     uint32_t h;
     tb_page_addr_t phys_pc;
 
-    assert_tb_locked();
+    assert_memory_lock();
 
+    /* make sure no further incoming jumps will be chained to this TB */
+    qemu_spin_lock(&tb->jmp_lock);
     atomic_set(&tb->cflags, tb->cflags | CF_INVALID);
+    qemu_spin_unlock(&tb->jmp_lock);
 
     /* remove the TB from the hash list */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
@@ -1091,12 +1531,12 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     /* remove the TB from the page list */
     if (tb->page_addr[0] != page_addr) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
-        tb_page_remove(&p->first_tb, tb);
+        tb_page_remove(p, tb);
         invalidate_page_bitmap(p);
     }
     if (tb->page_addr[1] != -1 && tb->page_addr[1] != page_addr) {
         p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
-        tb_page_remove(&p->first_tb, tb);
+        tb_page_remove(p, tb);
         invalidate_page_bitmap(p);
     }
 
@@ -1115,10 +1555,32 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
 
-    tb_ctx.tb_phys_invalidate_count++;
+    atomic_set(&tb_ctx.tb_phys_invalidate_count,
+               tb_ctx.tb_phys_invalidate_count + 1);
+}
+
+/* invalidate one TB, with its pages already locked */
+static void tb_phys_invalidate__locked(TranslationBlock *tb)
+{
+    do_tb_phys_invalidate(tb, -1);
+}
+
+/* invalidate one TB
+ *
+ * Called with mmap_lock held in user-mode.  In system emulation the
+ * TB's pages must not be locked by the caller, and @page_addr must be -1.
+ */
+void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
+{
+    PageDesc *p1, *p2;
+
+    page_lock_pair(&p1, tb->page_addr[0], &p2, tb->page_addr[1], 0);
+    do_tb_phys_invalidate(tb, page_addr);
+    page_unlock_pair(p1, p2);
 }
 
 #ifdef CONFIG_SOFTMMU
+/* Call with the page locked.  */
 static void build_page_bitmap(PageDesc *p)
 {
     int n, tb_start, tb_end;
@@ -1126,10 +1588,7 @@ static void build_page_bitmap(PageDesc *p)
 
     p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
 
-    tb = p->first_tb;
-    while (tb != NULL) {
-        n = (uintptr_t)tb & 3;
-        tb = (TranslationBlock *)((uintptr_t)tb & ~3);
+    PAGE_FOR_EACH_TB(p, tb, n) {
         /* NOTE: this is subtle as a TB may span two physical pages */
         if (n == 0) {
             /* NOTE: tb_end may be after the end of the page, but
@@ -1144,7 +1603,6 @@ static void build_page_bitmap(PageDesc *p)
             tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
         }
         bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
-        tb = tb->page_next[n];
     }
 }
 #endif
@@ -1152,11 +1610,11 @@ static void build_page_bitmap(PageDesc *p)
 /* add the tb in the target page and protect it if necessary
  *
  * Called with mmap_lock held for user-mode emulation.
+ * Called with the page locked for system emulation.
  */
-static inline void tb_alloc_page(TranslationBlock *tb,
-                                 unsigned int n, tb_page_addr_t page_addr)
+static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
+                               unsigned int n, tb_page_addr_t page_addr)
 {
-    PageDesc *p;
 #ifndef CONFIG_USER_ONLY
     bool page_already_protected;
 #endif
@@ -1164,7 +1622,6 @@ static inline void tb_alloc_page(TranslationBlock *tb,
     assert_memory_lock();
 
     tb->page_addr[n] = page_addr;
-    p = page_find_alloc(page_addr >> TARGET_PAGE_BITS, 1);
     tb->page_next[n] = p->first_tb;
 #ifndef CONFIG_USER_ONLY
     page_already_protected = p->first_tb != NULL;
@@ -1173,25 +1630,18 @@ static inline void tb_alloc_page(TranslationBlock *tb,
     invalidate_page_bitmap(p);
 
 #if defined(CONFIG_USER_ONLY)
-    if (p->flags & PAGE_WRITE) {
-        target_ulong addr;
-        PageDesc *p2;
+    if (page_get_flags(page_addr) & PAGE_WRITE) {
+        target_ulong last;
         int prot;
 
         /* force the host page as non writable (writes will have a
            page fault + mprotect overhead) */
         page_addr &= qemu_host_page_mask;
-        prot = 0;
-        for (addr = page_addr; addr < page_addr + qemu_host_page_size;
-            addr += TARGET_PAGE_SIZE) {
-
-            p2 = page_find(addr >> TARGET_PAGE_BITS);
-            if (!p2) {
-                continue;
-            }
-            prot |= p2->flags;
-            p2->flags &= ~PAGE_WRITE;
-          }
+        last = page_addr + qemu_host_page_size - 1;
+        qemu_mutex_lock(&page_flags_lock);
+        prot = page_flags_union(page_addr, last);
+        page_flags_modify(page_addr, last, PAGE_WRITE, 0, false);
+        qemu_mutex_unlock(&page_flags_lock);
         mprotect(g2h(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
         if (DEBUG_TB_INVALIDATE_GATE) {
@@ -1212,18 +1662,35 @@ static inline void tb_alloc_page(TranslationBlock *tb,
  * (-1) to indicate that only one page contains the TB.
  *
  * Called with mmap_lock held for user-mode emulation.
+ *
+ * Returns a pointer @tb, or a pointer to an existing TB that matches @tb.
+ * Note that in !user-mode, another thread might have already added a TB
+ * for the same block of guest code that @tb corresponds to. In that case,
+ * the caller should discard the original @tb, and use instead the returned TB.
  */
-static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
-                         tb_page_addr_t phys_page2)
+static TranslationBlock *
+tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
+             tb_page_addr_t phys_page2)
 {
+    PageDesc *p;
+    PageDesc *p2;
+    void *existing_tb = NULL;
     uint32_t h;
 
     assert_memory_lock();
 
-    /* add in the page list */
-    tb_alloc_page(tb, 0, phys_pc & TARGET_PAGE_MASK);
-    if (phys_page2 != -1) {
-        tb_alloc_page(tb, 1, phys_page2);
+    /*
+     * Add the TB to the page list, acquiring first the pages's locks.
+     * We keep the locks held until after inserting the TB in the hash table,
+     * so that if the insertion fails we know for sure that the TBs are still
+     * in the page descriptors.
+     * Note that inserting into the hash table first isn't an option, since
+     * we can only insert TBs that are fully initialized.
+     */
+    page_lock_pair(&p, phys_pc, &p2, phys_page2, 1);
+    tb_page_add(p, tb, 0, phys_pc & TARGET_PAGE_MASK);
+    if (p2) {
+        tb_page_add(p2, tb, 1, phys_page2);
     } else {
         tb->page_addr[1] = -1;
     }
@@ -1231,13 +1698,27 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     /* add in the hash table */
     h = tb_hash_func(phys_pc, tb->pc, tb->flags, tb->cflags & CF_HASH_MASK,
                      tb->trace_vcpu_dstate);
-    qht_insert(&tb_ctx.htable, tb, h);
+    qht_insert(&tb_ctx.htable, tb, h, &existing_tb);
+
+    /* remove TB from the page(s) if we couldn't insert it */
+    if (unlikely(existing_tb)) {
+        tb_page_remove(p, tb);
+        invalidate_page_bitmap(p);
+        if (p2) {
+            tb_page_remove(p2, tb);
+            invalidate_page_bitmap(p2);
+        }
+        tb = existing_tb;
+    }
+
+    page_unlock_pair(p, p2);
 
 #ifdef CONFIG_USER_ONLY
     if (DEBUG_TB_CHECK_GATE) {
         tb_page_check();
     }
 #endif
+    return tb;
 }
 
 /* Called with mmap_lock held for user mode emulation.  */
@@ -1246,7 +1727,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                               uint32_t flags, int cflags)
 {
     CPUArchState *env = cpu->env_ptr;
-    TranslationBlock *tb;
+    TranslationBlock *tb, *existing_tb;
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
@@ -1262,8 +1743,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* flush or eviction must be done */
+        if (tcg_region_evict_enabled()) {
+            tb_evict(cpu);
+        } else {
+            tb_flush(cpu);
+        }
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1277,6 +1762,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
     tcg_ctx->tb_cflags = cflags;
 
 #ifdef CONFIG_PROFILER
@@ -1325,6 +1811,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    translator_account_insn_stats(tcg_ctx, tb);
 
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1370,10 +1857,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                  CODE_GEN_ALIGN));
 
     /* init jump list */
-    assert(((uintptr_t)tb & 3) == 0);
-    tb->jmp_list_first = (uintptr_t)tb | 2;
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
     tb->jmp_list_next[0] = (uintptr_t)NULL;
     tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
 
     /* init original jump addresses wich has been set during tcg_gen_code() */
     if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
@@ -1389,66 +1878,92 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
-    /* As long as consistency of the TB stuff is provided by tb_lock in user
-     * mode and is implicit in single-threaded softmmu emulation, no explicit
-     * memory barrier is required before tb_link_page() makes the TB visible
-     * through the physical hash table and physical page list.
+    /*
+     * No explicit memory barrier is required -- tb_link_page() makes the
+     * TB visible in a consistent state.
      */
-    tb_link_page(tb, phys_pc, phys_page2);
-    g_tree_insert(tb_ctx.tb_tree, &tb->tc, tb);
+    existing_tb = tb_link_page(tb, phys_pc, phys_page2);
+    /* if the TB already exists, discard what we just translated */
+    if (unlikely(existing_tb != tb)) {
+        uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+
+        orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+        atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+        return existing_tb;
+    }
+    perf_report_code(tb);
+    tcg_tb_insert(tb);
     return tb;
 }
 
+#ifdef CONFIG_SOFTMMU
 /*
- * Invalidate all TBs which intersect with the target physical address range
- * [start;end[. NOTE: start and end may refer to *different* physical pages.
- * 'is_cpu_write_access' should be true if called from a real cpu write
- * access: the virtual CPU will exit the current TB if code is modified inside
- * this TB.
+ * Lock the page of @tb other than @p, whose lock is held and which is
+ * the @n-th page of @tb.  Return it in *@ret_p2, or NULL if @tb lies in
+ * @p only.
  *
- * Called with mmap_lock held for user-mode emulation, grabs tb_lock
- * Called with tb_lock held for system-mode emulation
+ * Pages are locked in increasing order, so if the other page comes
+ * first and is contended, we drop the lock of @p and take both locks
+ * in order.  Return false in that case: @p may have changed while it
+ * was unlocked, so the caller must restart its traversal of @p's list
+ * (after unlocking the other page).
  */
-static void tb_invalidate_phys_range_1(tb_page_addr_t start, tb_page_addr_t end)
+static bool tb_page_lock_other(PageDesc *p, TranslationBlock *tb, int n,
+                               PageDesc **ret_p2)
 {
-    while (start < end) {
-        tb_invalidate_phys_page_range(start, end, 0);
-        start &= TARGET_PAGE_MASK;
-        start += TARGET_PAGE_SIZE;
-    }
-}
+    tb_page_addr_t other = tb->page_addr[n ^ 1];
+    PageDesc *p2;
 
-#ifdef CONFIG_SOFTMMU
-void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
-{
-    assert_tb_locked();
-    tb_invalidate_phys_range_1(start, end);
+    *ret_p2 = NULL;
+    if (other == -1) {
+        return true;
+    }
+    p2 = page_find(other >> TARGET_PAGE_BITS);
+    if (p2 == p) {
+        return true;
+    }
+    *ret_p2 = p2;
+    if (other > tb->page_addr[n]) {
+        page_lock(p2);
+        return true;
+    }
+    if (page_trylock(p2)) {
+        return true;
+    }
+    page_unlock(p);
+    page_lock(p2);
+    page_lock(p);
+    return false;
 }
 #else
-void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
+/* The mmap_lock protects all the pages.  */
+static bool tb_page_lock_other(PageDesc *p, TranslationBlock *tb, int n,
+                               PageDesc **ret_p2)
 {
-    assert_memory_lock();
-    tb_lock();
-    tb_invalidate_phys_range_1(start, end);
-    tb_unlock();
+    *ret_p2 = NULL;
+    return true;
 }
 #endif
+
 /*
  * Invalidate all TBs which intersect with the target physical address range
- * [start;end[. NOTE: start and end must refer to the *same* physical page.
+ * [start;end[ of the page @p. NOTE: start and end must refer to the *same*
+ * physical page, that of @p.
  * 'is_cpu_write_access' should be true if called from a real cpu write
  * access: the virtual CPU will exit the current TB if code is modified inside
  * this TB.
  *
- * Called with tb_lock/mmap_lock held for user-mode emulation
- * Called with tb_lock held for system-mode emulation
+ * Called with mmap_lock held for user-mode emulation.
+ * Called with @p locked; @p is unlocked on return, or before leaving the
+ * current TB.
  */
-void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
-                                   int is_cpu_write_access)
+static void
+tb_invalidate_phys_page_range__locked(PageDesc *p, tb_page_addr_t start,
+                                      tb_page_addr_t end,
+                                      int is_cpu_write_access)
 {
-    TranslationBlock *tb, *tb_next;
+    TranslationBlock *tb;
     tb_page_addr_t tb_start, tb_end;
-    PageDesc *p;
     int n;
 #ifdef TARGET_HAS_PRECISE_SMC
     CPUState *cpu = current_cpu;
@@ -1462,12 +1977,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
 #endif /* TARGET_HAS_PRECISE_SMC */
 
     assert_memory_lock();
-    assert_tb_locked();
 
-    p = page_find(start >> TARGET_PAGE_BITS);
-    if (!p) {
-        return;
-    }
 #if defined(TARGET_HAS_PRECISE_SMC)
     if (cpu != NULL) {
         env = cpu->env_ptr;
@@ -1477,11 +1987,8 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
     /* we remove all the TBs in the range [start, end[ */
     /* XXX: see if in some cases it could be faster to invalidate all
        the code */
-    tb = p->first_tb;
-    while (tb != NULL) {
-        n = (uintptr_t)tb & 3;
-        tb = (TranslationBlock *)((uintptr_t)tb & ~3);
-        tb_next = tb->page_next[n];
+ restart:
+    PAGE_FOR_EACH_TB(p, tb, n) {
         /* NOTE: this is subtle as a TB may span two physical pages */
         if (n == 0) {
             /* NOTE: tb_end may be after the end of the page, but
@@ -1493,13 +2000,19 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
             tb_end = tb_start + ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
         }
         if (!(tb_end <= start || tb_start >= end)) {
+            PageDesc *p2;
+
+            if (!tb_page_lock_other(p, tb, n, &p2)) {
+                page_unlock(p2);
+                goto restart;
+            }
 #ifdef TARGET_HAS_PRECISE_SMC
             if (current_tb_not_found) {
                 current_tb_not_found = 0;
                 current_tb = NULL;
                 if (cpu->mem_io_pc) {
                     /* now we have a real cpu fault */
-                    current_tb = tb_find_pc(cpu->mem_io_pc);
+                    current_tb = tcg_tb_lookup(cpu->mem_io_pc);
                 }
             }
             if (current_tb == tb &&
@@ -1516,9 +2029,11 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
                                      &current_flags);
             }
 #endif /* TARGET_HAS_PRECISE_SMC */
-            tb_phys_invalidate(tb, -1);
+            tb_phys_invalidate__locked(tb);
+            if (p2) {
+                page_unlock(p2);
+            }
         }
-        tb = tb_next;
     }
 #if !defined(CONFIG_USER_ONLY)
     /* if no code remaining, no need to continue to use slow writes */
@@ -1527,6 +2042,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
         tlb_unprotect_code(start);
     }
 #endif
+    page_unlock(p);
 #ifdef TARGET_HAS_PRECISE_SMC
     if (current_tb_modified) {
         /* Force execution of one insn next time.  */
@@ -1536,6 +2052,55 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
 #endif
 }
 
+/*
+ * Invalidate all TBs which intersect with the target physical address range
+ * [start;end[. NOTE: start and end must refer to the *same* physical page.
+ * 'is_cpu_write_access' should be true if called from a real cpu write
+ * access: the virtual CPU will exit the current TB if code is modified inside
+ * this TB.
+ *
+ * Called with mmap_lock held for user-mode emulation
+ */
+void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
+                                   int is_cpu_write_access)
+{
+    PageDesc *p;
+
+    assert_memory_lock();
+
+    p = page_find(start >> TARGET_PAGE_BITS);
+    if (p == NULL) {
+        return;
+    }
+    page_lock(p);
+    tb_invalidate_phys_page_range__locked(p, start, end, is_cpu_write_access);
+}
+
+/*
+ * Invalidate all TBs which intersect with the target physical address range
+ * [start;end[. NOTE: start and end may refer to *different* physical pages.
+ *
+ * Called with mmap_lock held for user-mode emulation.
+ */
+void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
+{
+    tb_page_addr_t index, last;
+
+    assert_memory_lock();
+
+    if (start >= end) {
+        return;
+    }
+    last = (end - 1) >> TARGET_PAGE_BITS;
+    for (index = page_find_next(start >> TARGET_PAGE_BITS, last);
+         index <= last;
+         index = page_find_next(index + 1, last)) {
+        tb_page_addr_t addr = index << TARGET_PAGE_BITS;
+
+        tb_invalidate_phys_page_range(MAX(addr, start), end, 0);
+    }
+}
+
 #ifdef CONFIG_SOFTMMU
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
@@ -1560,11 +2125,10 @@ void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len)
     if (!p) {
         return;
     }
+
+    page_lock(p);
     if (!p->code_bitmap &&
         ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
-        /* build code bitmap.  FIXME: writes should be protected by
-         * tb_lock, reads by tb_lock or RCU.
-         */
         build_page_bitmap(p);
     }
     if (p->code_bitmap) {
@@ -1578,8 +2142,10 @@ void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len)
         }
     } else {
     do_invalidate:
-        tb_invalidate_phys_page_range(start, start + len, 1);
+        tb_invalidate_phys_page_range__locked(p, start, start + len, 1);
+        return;
     }
+    page_unlock(p);
 }
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
@@ -1611,19 +2177,15 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
         return false;
     }
 
-    tb_lock();
-    tb = p->first_tb;
 #ifdef TARGET_HAS_PRECISE_SMC
-    if (tb && pc != 0) {
-        current_tb = tb_find_pc(pc);
+    if (p->first_tb && pc != 0) {
+        current_tb = tcg_tb_lookup(pc);
     }
     if (cpu != NULL) {
         env = cpu->env_ptr;
     }
 #endif
-    while (tb != NULL) {
-        n = (uintptr_t)tb & 3;
-        tb = (TranslationBlock *)((uintptr_t)tb & ~3);
+    PAGE_FOR_EACH_TB(p, tb, n) {
 #ifdef TARGET_HAS_PRECISE_SMC
         if (current_tb == tb &&
             (current_tb->cflags & CF_COUNT_MASK) != 1) {
@@ -1640,36 +2202,20 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
         }
 #endif /* TARGET_HAS_PRECISE_SMC */
         tb_phys_invalidate(tb, addr);
-        tb = tb->page_next[n];
     }
     p->first_tb = NULL;
 #ifdef TARGET_HAS_PRECISE_SMC
     if (current_tb_modified) {
         /* Force execution of one insn next time.  */
         cpu->cflags_next_tb = 1 | curr_cflags();
-        /* tb_lock will be reset after cpu_loop_exit_noexc longjmps
-         * back into the cpu_exec loop. */
         return true;
     }
 #endif
-    tb_unlock();
 
     return false;
 }
 #endif
 
-/*
- * Find the TB 'tb' such that
- * tb->tc.ptr <= tc_ptr < tb->tc.ptr + tb->tc.size
- * Return NULL if not found.
- */
-static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
-{
-    struct tb_tc s = { .ptr = (void *)tc_ptr };
-
-    return g_tree_lookup(tb_ctx.tb_tree, &s);
-}
-
 #if !defined(CONFIG_USER_ONLY)
 void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr)
 {
@@ -1685,19 +2231,16 @@ void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr)
         return;
     }
     ram_addr = memory_region_get_ram_addr(mr) + addr;
-    tb_lock();
     tb_invalidate_phys_page_range(ram_addr, ram_addr + 1, 0);
-    tb_unlock();
     rcu_read_unlock();
 }
 #endif /* !defined(CONFIG_USER_ONLY) */
 
-/* Called with tb_lock held.  */
 void tb_check_watchpoint(CPUState *cpu)
 {
     TranslationBlock *tb;
 
-    tb = tb_find_pc(cpu->mem_io_pc);
+    tb = tcg_tb_lookup(cpu->mem_io_pc);
     if (tb) {
         /* We can use retranslation to find the PC.  */
         cpu_restore_state_from_tb(cpu, tb, cpu->mem_io_pc);
@@ -1716,6 +2259,81 @@ void tb_check_watchpoint(CPUState *cpu)
     }
 }
 
+/* Hot TB profiling (-d hot_tbs).  */
+
+struct tb_hot_stats {
+    GPtrArray *tbs;
+    uint64_t total;
+};
+
+static gboolean tb_hot_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    struct tb_hot_stats *ths = data;
+
+    if (tb->exec_count) {
+        g_ptr_array_add(ths->tbs, tb);
+        ths->total += tb->exec_count;
+    }
+    return false;
+}
+
+static gint tb_hot_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const TranslationBlock *a = *(const TranslationBlock **)ap;
+    const TranslationBlock *b = *(const TranslationBlock **)bp;
+
+    if (a->exec_count != b->exec_count) {
+        return a->exec_count > b->exec_count ? -1 : 1;
+    }
+    return a->pc < b->pc ? -1 : a->pc > b->pc;
+}
+
+/* Free ths->tbs with g_ptr_array_free.  */
+static void tb_hot_collect(struct tb_hot_stats *ths)
+{
+    ths->tbs = g_ptr_array_new();
+    ths->total = 0;
+    tcg_tb_foreach(tb_hot_iter, ths);
+    g_ptr_array_sort(ths->tbs, tb_hot_cmp);
+}
+
+/*
+ * Print the @max most executed TBs.  Counts are kept in the TBs
+ * themselves, so they restart from zero after a TB flush.
+ */
+void dump_hot_tbs(FILE *f, fprintf_function cpu_fprintf, int max)
+{
+    struct tb_hot_stats ths;
+    guint i;
+
+    tb_hot_collect(&ths);
+
+    cpu_fprintf(f, "Hot TBs (%u of %zu executed, %" PRIu64 " executions):\n",
+                ths.tbs->len, tcg_nb_tbs(), ths.total);
+    cpu_fprintf(f, "%-18s %14s %6s %5s %5s %5s  %s\n",
+                "guest pc", "count", "share", "insns", "size", "host",
+                "symbol");
+    for (i = 0; i < ths.tbs->len && i < max; i++) {
+        TranslationBlock *tb = g_ptr_array_index(ths.tbs, i);
+
+        cpu_fprintf(f, "0x%016" PRIx64 " %14" PRIu64 " %5.1f%% %5u %5u %5u"
+                    "  %s\n", (uint64_t)tb->pc, tb->exec_count,
+                    (double)tb->exec_count * 100 / ths.total,
+                    tb->icount, tb->size, (unsigned)tb->tc.size,
+                    lookup_symbol(tb->pc));
+    }
+
+    g_ptr_array_free(ths.tbs, true);
+}
+
+void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf)
+{
+    translator_dump_insn_stats(f, cpu_fprintf);
+    cpu_fprintf(f, "\n");
+    tcg_dump_op_count(f, cpu_fprintf);
+}
+
 #ifndef CONFIG_USER_ONLY
 /* in deterministic execution mode, instructions doing device I/Os
  * must be at the end of the TB.
@@ -1730,8 +2348,7 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
     TranslationBlock *tb;
     uint32_t n;
 
-    tb_lock();
-    tb = tb_find_pc(retaddr);
+    tb = tcg_tb_lookup(retaddr);
     if (!tb) {
         cpu_abort(cpu, "cpu_io_recompile: could not find TB for pc=%p",
                   (void *)retaddr);
@@ -1775,7 +2392,7 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
              * cpu_exec_nocache() */
             tb_phys_invalidate(tb->orig_tb, -1);
         }
-        tb_remove(tb);
+        tcg_tb_remove(tb);
     }
 
     /* TODO: If env->pc != tb->pc (i.e. the faulting instruction was not
@@ -1783,9 +2400,6 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
      *  repeating the fault, which is horribly inefficient.
      *  Better would be to execute just this insn uncached, or generate a
      *  second new TB.
-     *
-     * cpu_loop_exit_noexc will longjmp back to cpu_exec where the
-     * tb_lock gets reset.
      */
     cpu_loop_exit_noexc(cpu);
 }
@@ -1876,16 +2490,50 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+#ifdef CONFIG_LINUX
+/*
+ * Add up the resident and the huge page backed kilobytes of the mappings
+ * that make up code_gen_buffer, as reported by /proc/self/smaps.
+ */
+static bool code_gen_buffer_hugepage_usage(size_t *rss_kb, size_t *huge_kb)
+{
+    uintptr_t buf_start = (uintptr_t)tcg_init_ctx.code_gen_buffer;
+    uintptr_t buf_end = buf_start + tcg_init_ctx.code_gen_buffer_size;
+    bool in_buffer = false;
+    char line[256];
+    FILE *smaps;
+
+    smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) {
+        return false;
+    }
+    *rss_kb = *huge_kb = 0;
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long start, end, kb;
+
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            in_buffer = start < buf_end && end > buf_start;
+        } else if (!in_buffer) {
+            continue;
+        } else if (sscanf(line, "Rss: %lu kB", &kb) == 1) {
+            *rss_kb += kb;
+        } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            *huge_kb += kb;
+        }
+    }
+    fclose(smaps);
+    return true;
+}
+#endif
+
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs;
 
-    tb_lock();
-
-    nb_tbs = g_tree_nnodes(tb_ctx.tb_tree);
-    g_tree_foreach(tb_ctx.tb_tree, tb_tree_stats_iter, &tst);
+    nb_tbs = tcg_nb_tbs();
+    tcg_tb_foreach(tb_tree_stats_iter, &tst);
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
     /*
@@ -1895,6 +2543,16 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
      */
     cpu_fprintf(f, "gen code size       %zu/%zu\n",
                 tcg_code_size(), tcg_code_capacity());
+#ifdef CONFIG_LINUX
+    {
+        size_t rss_kb, huge_kb;
+
+        if (code_gen_buffer_hugepage_usage(&rss_kb, &huge_kb)) {
+            cpu_fprintf(f, "huge page coverage  %zu/%zu kB (%zu%%)\n",
+                        huge_kb, rss_kb, rss_kb ? huge_kb * 100 / rss_kb : 0);
+        }
+    }
+#endif
     cpu_fprintf(f, "TB count            %zu\n", nb_tbs);
     cpu_fprintf(f, "TB avg target size  %zu max=%zu bytes\n",
                 nb_tbs ? tst.target_size / nb_tbs : 0,
@@ -1917,16 +2575,58 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
-    cpu_fprintf(f, "TB invalidate count %d\n", tb_ctx.tb_phys_invalidate_count);
+    if (tcg_region_evict_enabled()) {
+        cpu_fprintf(f, "TB evict count      %zu regions\n",
+                    tcg_region_evict_count());
+    }
+    cpu_fprintf(f, "TB invalidate count %d\n",
+                atomic_read(&tb_ctx.tb_phys_invalidate_count));
     cpu_fprintf(f, "TLB flush count     %zu\n", tlb_flush_count());
     tcg_dump_info(f, cpu_fprintf);
 
-    tb_unlock();
+    if (qemu_loglevel_mask(CPU_LOG_TB_HOT)) {
+        cpu_fprintf(f, "\n");
+        dump_hot_tbs(f, cpu_fprintf, 20);
+    }
 }
 
-void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf)
+HotTBInfoList *qmp_x_query_hot_tbs(bool has_max, int64_t max, Error **errp)
 {
-    tcg_dump_op_count(f, cpu_fprintf);
+    struct tb_hot_stats ths;
+    HotTBInfoList *head = NULL, **tail = &head;
+    guint i;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "JIT information is only available with accel=tcg");
+        return NULL;
+    }
+    if (!has_max) {
+        max = 20;
+    }
+
+    tb_hot_collect(&ths);
+    for (i = 0; i < ths.tbs->len && i < max; i++) {
+        TranslationBlock *tb = g_ptr_array_index(ths.tbs, i);
+        HotTBInfoList *entry = g_new0(HotTBInfoList, 1);
+        HotTBInfo *info = g_new0(HotTBInfo, 1);
+        const char *symbol = lookup_symbol(tb->pc);
+
+        info->pc = tb->pc;
+        info->count = tb->exec_count;
+        info->guest_insns = tb->icount;
+        info->guest_size = tb->size;
+        info->host_size = tb->tc.size;
+        if (symbol[0] != '\0') {
+            info->has_symbol = true;
+            info->symbol = g_strdup(symbol);
+        }
+        entry->value = info;
+        *tail = entry;
+        tail = &entry->next;
+    }
+    g_ptr_array_free(ths.tbs, true);
+
+    return head;
 }
 
 #else /* CONFIG_USER_ONLY */
@@ -1942,88 +2642,28 @@ void cpu_interrupt(CPUState *cpu, int mask)
  * Walks guest process memory "regions" one by one
  * and calls callback function 'fn' for each region.
  */
-struct walk_memory_regions_data {
-    walk_memory_regions_fn fn;
-    void *priv;
-    target_ulong start;
-    int prot;
-};
-
-static int walk_memory_regions_end(struct walk_memory_regions_data *data,
-                                   target_ulong end, int new_prot)
-{
-    if (data->start != -1u) {
-        int rc = data->fn(data->priv, data->start, end, data->prot);
-        if (rc != 0) {
-            return rc;
-        }
-    }
-
-    data->start = (new_prot ? end : -1u);
-    data->prot = new_prot;
-
-    return 0;
-}
-
-static int walk_memory_regions_1(struct walk_memory_regions_data *data,
-                                 target_ulong base, int level, void **lp)
-{
-    target_ulong pa;
-    int i, rc;
-
-    if (*lp == NULL) {
-        return walk_memory_regions_end(data, base, 0);
-    }
-
-    if (level == 0) {
-        PageDesc *pd = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            int prot = pd[i].flags;
-
-            pa = base | (i << TARGET_PAGE_BITS);
-            if (prot != data->prot) {
-                rc = walk_memory_regions_end(data, pa, prot);
-                if (rc != 0) {
-                    return rc;
-                }
-            }
-        }
-    } else {
-        void **pp = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            pa = base | ((target_ulong)i <<
-                (TARGET_PAGE_BITS + V_L2_BITS * level));
-            rc = walk_memory_regions_1(data, pa, level - 1, pp + i);
-            if (rc != 0) {
-                return rc;
-            }
-        }
-    }
-
-    return 0;
-}
-
 int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 {
-    struct walk_memory_regions_data data;
-    uintptr_t i, l1_sz = v_l1_size;
+    PageFlagsRange *ranges;
+    GSequenceIter *it;
+    size_t i, n;
+    int rc = 0;
 
-    data.fn = fn;
-    data.priv = priv;
-    data.start = -1u;
-    data.prot = 0;
-
-    for (i = 0; i < l1_sz; i++) {
-        target_ulong base = i << (v_l1_shift + TARGET_PAGE_BITS);
-        int rc = walk_memory_regions_1(&data, base, v_l2_levels, l1_map + i);
-        if (rc != 0) {
-            return rc;
-        }
+    /* Work on a copy, so that fn may look at the page flags itself.  */
+    qemu_mutex_lock(&page_flags_lock);
+    n = g_sequence_get_length(page_flags_map);
+    ranges = g_new(PageFlagsRange, n);
+    it = g_sequence_get_begin_iter(page_flags_map);
+    for (i = 0; i < n; i++, it = g_sequence_iter_next(it)) {
+        ranges[i] = *(PageFlagsRange *)g_sequence_get(it);
     }
+    qemu_mutex_unlock(&page_flags_lock);
 
-    return walk_memory_regions_end(&data, 0, 0);
+    for (i = 0; i < n && rc == 0; i++) {
+        rc = fn(priv, ranges[i].start, ranges[i].last + 1, ranges[i].flags);
+    }
+    g_free(ranges);
+    return rc;
 }
 
 static int dump_region(void *priv, target_ulong start,
@@ -2052,13 +2692,30 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    int flags;
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        return 0;
+    qemu_mutex_lock(&page_flags_lock);
+    flags = page_flags_lookup(address);
+    qemu_mutex_unlock(&page_flags_lock);
+    return flags;
+}
+
+/* Invalidate the code in the pages of [start, last] that hold some
+   and are not writable.  The mmap_lock should already be held.  */
+static void page_invalidate_unwritable(target_ulong start, target_ulong last)
+{
+    tb_page_addr_t index, last_index = last >> TARGET_PAGE_BITS;
+
+    for (index = page_find_next(start >> TARGET_PAGE_BITS, last_index);
+         index <= last_index;
+         index = page_find_next(index + 1, last_index)) {
+        target_ulong addr = (target_ulong)index << TARGET_PAGE_BITS;
+
+        if (page_find(index)->first_tb &&
+            !(page_get_flags(addr) & PAGE_WRITE)) {
+            tb_invalidate_phys_page(addr, 0);
+        }
     }
-    return p->flags;
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -2066,7 +2723,7 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
+    target_ulong last;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2077,34 +2734,30 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     assert(start < end);
     assert_memory_lock();
 
+    /* end may be ~0ul, so work with the last byte of the last page.  */
+    last = (end - 1) | ~TARGET_PAGE_MASK;
     start = start & TARGET_PAGE_MASK;
-    end = TARGET_PAGE_ALIGN(end);
 
     if (flags & PAGE_WRITE) {
         flags |= PAGE_WRITE_ORG;
-    }
-
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
 
         /* If the write protection bit is set, then we invalidate
            the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
-        }
-        p->flags = flags;
+        page_invalidate_unwritable(start, last);
     }
+
+    qemu_mutex_lock(&page_flags_lock);
+    page_flags_modify(start, last, -1, flags, true);
+    qemu_mutex_unlock(&page_flags_lock);
 }
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
-    target_ulong end;
+    target_ulong last;
     target_ulong addr;
+    GSequenceIter *it;
+    bool unprotect = false;
+    int ret = 0;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2122,37 +2775,121 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     }
 
     /* must do before we loose bits in the next step */
-    end = TARGET_PAGE_ALIGN(start + len);
+    last = (start + len - 1) | ~TARGET_PAGE_MASK;
     start = start & TARGET_PAGE_MASK;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
+    qemu_mutex_lock(&page_flags_lock);
+    addr = start;
+    for (it = page_flags_find(start); ; it = g_sequence_iter_next(it)) {
+        PageFlagsRange *r = page_flags_range(it);
+
+        if (!r || r->start > addr) {
+            ret = -1;
+            break;
         }
-        if (!(p->flags & PAGE_VALID)) {
-            return -1;
+        if (!(r->flags & PAGE_VALID)) {
+            ret = -1;
+            break;
         }
-
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
+        if ((flags & PAGE_READ) && !(r->flags & PAGE_READ)) {
+            ret = -1;
+            break;
         }
         if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
+            if (!(r->flags & PAGE_WRITE_ORG)) {
+                ret = -1;
+                break;
+            }
+            if (!(r->flags & PAGE_WRITE)) {
+                unprotect = true;
+            }
+        }
+        if (r->last >= last) {
+            break;
+        }
+        addr = r->last + 1;
+    }
+    qemu_mutex_unlock(&page_flags_lock);
+
+    if (ret == 0 && unprotect) {
+        /* unprotect the pages that were put read-only because they
+           contain translated code */
+        for (addr = start; ; addr += TARGET_PAGE_SIZE) {
+            if (!(page_get_flags(addr) & PAGE_WRITE) &&
+                !page_unprotect(addr, 0)) {
                 return -1;
             }
-            /* unprotect the page if it was put read-only because it
-               contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
-                    return -1;
-                }
+            if (addr == (last & TARGET_PAGE_MASK)) {
+                break;
             }
         }
     }
-    return 0;
+    return ret;
+}
+
+/* Return the highest address aligned to @align at which @len bytes
+ * fit between @min and @max (inclusive) without touching a mapped
+ * page, or -1 if there is none.  The mmap_lock should already be held.
+ */
+target_ulong page_find_range_empty(target_ulong min, target_ulong max,
+                                   target_ulong len, target_ulong align)
+{
+    target_ulong top = max, ret = -1;
+    GSequenceIter *it;
+
+    assert(len != 0);
+    assert_memory_lock();
+
+    qemu_mutex_lock(&page_flags_lock);
+    it = page_flags_find(top);
+    while (top >= min) {
+        PageFlagsRange *r = page_flags_range(it);
+        target_ulong bottom = 0, addr;
+        bool first = g_sequence_iter_is_begin(it);
+
+        if (r && r->start <= top) {
+            /* top is mapped: look below the range that holds it.  */
+            if (r->start == 0) {
+                break;
+            }
+            top = r->start - 1;
+            continue;
+        }
+
+        /* [bottom, top] is free.  */
+        if (!first) {
+            it = g_sequence_iter_prev(it);
+            bottom = page_flags_range(it)->last + 1;
+        }
+        bottom = MAX(bottom, min);
+        if (bottom <= top && top - bottom >= len - 1) {
+            addr = (top - (len - 1)) & -align;
+            if (addr >= bottom) {
+                ret = addr;
+                break;
+            }
+        }
+        if (first) {
+            break;
+        }
+    }
+    qemu_mutex_unlock(&page_flags_lock);
+    return ret;
+}
+
+/* Make sure the page flags are in a consistent state across fork().  */
+void page_flags_fork_start(void)
+{
+    qemu_mutex_lock(&page_flags_lock);
+}
+
+void page_flags_fork_end(int child)
+{
+    if (child) {
+        qemu_mutex_init(&page_flags_lock);
+    } else {
+        qemu_mutex_unlock(&page_flags_lock);
+    }
 }
 
 /* called from signal handler: invalidate the code and unprotect the
@@ -2165,45 +2902,42 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 {
     unsigned int prot;
     bool current_tb_invalidated;
-    PageDesc *p;
-    target_ulong host_start, host_end, addr;
+    int flags;
+    target_ulong host_start, host_last, addr;
 
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        mmap_unlock();
-        return 0;
-    }
+    flags = page_get_flags(address);
 
     /* if the page was really writable, then we change its
        protection back to writable */
-    if (p->flags & PAGE_WRITE_ORG) {
+    if (flags & PAGE_WRITE_ORG) {
         current_tb_invalidated = false;
-        if (p->flags & PAGE_WRITE) {
+        if (flags & PAGE_WRITE) {
             /* If the page is actually marked WRITE then assume this is because
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
              */
 #ifdef TARGET_HAS_PRECISE_SMC
-            TranslationBlock *current_tb = tb_find_pc(pc);
+            TranslationBlock *current_tb = tcg_tb_lookup(pc);
             if (current_tb) {
                 current_tb_invalidated = tb_cflags(current_tb) & CF_INVALID;
             }
 #endif
         } else {
             host_start = address & qemu_host_page_mask;
-            host_end = host_start + qemu_host_page_size;
+            host_last = host_start + qemu_host_page_size - 1;
 
-            prot = 0;
-            for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
-                p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
-                prot |= p->flags;
+            qemu_mutex_lock(&page_flags_lock);
+            page_flags_modify(host_start, host_last, 0, PAGE_WRITE, false);
+            prot = page_flags_union(host_start, host_last);
+            qemu_mutex_unlock(&page_flags_lock);
 
+            for (addr = host_start; addr < host_last;
+                 addr += TARGET_PAGE_SIZE) {
                 /* and since the content will be modified, we must invalidate
                    the corresponding translated code. */
                 current_tb_invalidated |= tb_invalidate_phys_page(addr, pc);
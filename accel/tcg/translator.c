@@ -10,6 +10,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/error-report.h"
+#include "qemu/stats64.h"
 #include "cpu.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
@@ -31,9 +32,152 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+/* Per-class instruction statistics (-d insn_stats, -d insn_exec).  */
+typedef struct InsnClassStats {
+    Stat64 translated;
+    Stat64 ops;
+    Stat64 host_bytes;
+    /* Updated racily by the generated code */
+    uint64_t executed;
+} InsnClassStats;
+
+static const char * const *insn_class_names;
+static unsigned insn_class_count;
+static InsnClassStats *insn_class_stats;
+
+void translator_register_insn_classes(const char * const *names, unsigned n)
+{
+    insn_class_names = names;
+    insn_class_count = n;
+    insn_class_stats = g_new0(InsnClassStats, n);
+}
+
+/*
+ * Count executions of the instruction that is about to be translated.
+ * Its class is not known yet, so return the op that loads the address
+ * of the counter; translator_record_insn patches it.
+ */
+static TCGOp *gen_insn_exec_count(void)
+{
+    TCGv_ptr ptr = tcg_const_ptr(NULL);
+    TCGOp *op = tcg_last_op();
+    TCGv_i64 n = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(n, ptr, 0);
+    tcg_gen_addi_i64(n, n, 1);
+    tcg_gen_st_i64(n, ptr, 0);
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(ptr);
+    return op;
+}
+
+/*
+ * Note the class of the instruction just translated, and the number of
+ * ops it produced after @last_op.
+ */
+static void translator_record_insn(DisasContextBase *db, TCGOp *last_op,
+                                   TCGOp *count_op)
+{
+    unsigned cls = db->insn_class < insn_class_count ? db->insn_class : 0;
+    unsigned n = 0;
+
+    while ((last_op = QTAILQ_NEXT(last_op, link)) != NULL) {
+        n++;
+    }
+    tcg_ctx->gen_insn_class[db->num_insns - 1] = cls;
+    tcg_ctx->gen_insn_ops[db->num_insns - 1] = MIN(n, UINT16_MAX);
+    if (count_op) {
+        tcg_set_insn_param(count_op, 1,
+                           (uintptr_t)&insn_class_stats[cls].executed);
+    }
+}
+
+void translator_account_insn_stats(TCGContext *s, TranslationBlock *tb)
+{
+    unsigned i, prev_off = 0;
+
+    if (!s->gen_insn_stats) {
+        return;
+    }
+    for (i = 0; i < tb->icount; i++) {
+        InsnClassStats *st = &insn_class_stats[s->gen_insn_class[i]];
+
+        stat64_add(&st->translated, 1);
+        stat64_add(&st->ops, s->gen_insn_ops[i]);
+        stat64_add(&st->host_bytes, s->gen_insn_end_off[i] - prev_off);
+        prev_off = s->gen_insn_end_off[i];
+    }
+}
+
+typedef struct InsnClassSortEntry {
+    uint64_t key;
+    unsigned cls;
+} InsnClassSortEntry;
+
+static int insn_class_sort_cmp(const void *ap, const void *bp)
+{
+    const InsnClassSortEntry *a = ap;
+    const InsnClassSortEntry *b = bp;
+
+    if (a->key != b->key) {
+        return a->key > b->key ? -1 : 1;
+    }
+    return a->cls - b->cls;
+}
+
+void translator_dump_insn_stats(FILE *f, fprintf_function cpu_fprintf)
+{
+    InsnClassSortEntry *sorted;
+    bool by_exec = false;
+    unsigned i, n = 0;
+
+    if (!insn_class_stats) {
+        cpu_fprintf(f, "[instruction classes not supported by this target]\n");
+        return;
+    }
+
+    for (i = 0; i < insn_class_count; i++) {
+        by_exec |= insn_class_stats[i].executed != 0;
+    }
+    sorted = g_new(InsnClassSortEntry, insn_class_count);
+    for (i = 0; i < insn_class_count; i++) {
+        InsnClassStats *st = &insn_class_stats[i];
+        uint64_t translated = stat64_get(&st->translated);
+
+        if (translated) {
+            sorted[n].key = by_exec ? st->executed : translated;
+            sorted[n].cls = i;
+            n++;
+        }
+    }
+    if (n == 0) {
+        cpu_fprintf(f, "[no instruction statistics; enable them with "
+                    "\"log insn_stats\" or \"log insn_exec\"]\n");
+        g_free(sorted);
+        return;
+    }
+    qsort(sorted, n, sizeof(*sorted), insn_class_sort_cmp);
+
+    cpu_fprintf(f, "%-12s %12s %14s %9s %10s\n", "insn class",
+                "translated", "executed", "ops/insn", "host/insn");
+    for (i = 0; i < n; i++) {
+        InsnClassStats *st = &insn_class_stats[sorted[i].cls];
+        uint64_t translated = stat64_get(&st->translated);
+
+        cpu_fprintf(f, "%-12s %12" PRIu64 " %14" PRIu64 " %9.1f %10.1f\n",
+                    insn_class_names[sorted[i].cls], translated, st->executed,
+                    (double)stat64_get(&st->ops) / translated,
+                    (double)stat64_get(&st->host_bytes) / translated);
+    }
+    g_free(sorted);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb)
 {
+    bool insn_stats = insn_class_stats &&
+        qemu_loglevel_mask(CPU_LOG_INSN_STATS | CPU_LOG_INSN_EXEC);
+    bool insn_exec = insn_stats && qemu_loglevel_mask(CPU_LOG_INSN_EXEC);
     int max_insns;
 
     /* Initialize DisasContext */
@@ -43,6 +187,7 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->is_jmp = DISAS_NEXT;
     db->num_insns = 0;
     db->singlestep_enabled = cpu->singlestep_enabled;
+    tcg_ctx->gen_insn_stats = insn_stats;
 
     /* Instruction counting */
     max_insns = tb_cflags(db->tb) & CF_COUNT_MASK;
@@ -68,10 +213,18 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
     while (true) {
+        TCGOp *last_op = NULL, *count_op = NULL;
+
         db->num_insns++;
         ops->insn_start(db, cpu);
         tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
+        if (insn_stats) {
+            /* In case a breakpoint ends the TB before translate_insn */
+            tcg_ctx->gen_insn_class[db->num_insns - 1] = 0;
+            tcg_ctx->gen_insn_ops[db->num_insns - 1] = 0;
+        }
+
         /* Pass breakpoint hits to target for further processing */
         if (unlikely(!QTAILQ_EMPTY(&cpu->breakpoints))) {
             CPUBreakpoint *bp;
@@ -95,6 +248,13 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
            update db->pc_next and db->is_jmp to indicate what should be
            done next -- either exiting this loop or locate the start of
            the next instruction.  */
+        if (insn_exec) {
+            count_op = gen_insn_exec_count();
+        }
+        if (insn_stats) {
+            last_op = tcg_last_op();
+        }
+        db->insn_class = 0;
         if (db->num_insns == max_insns && (tb_cflags(db->tb) & CF_LAST_IO)) {
             /* Accept I/O on the last instruction.  */
             gen_io_start();
@@ -103,6 +263,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
         } else {
             ops->translate_insn(db, cpu);
         }
+        if (insn_stats) {
+            translator_record_insn(db, last_op, count_op);
+        }
 
         /* Stop translation if translate_insn so indicated.  */
         if (db->is_jmp != DISAS_NEXT) {
@@ -654,7 +654,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
 /* The following is only callable from other helpers, and matches up
    with the softmmu version.  */
 
-#ifdef CONFIG_ATOMIC128
+#if HAVE_CMPXCHG128
 
 #undef EXTRA_ARGS
 #undef ATOMIC_NAME
@@ -667,4 +667,77 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
 
 #define DATA_SIZE 16
 #include "atomic_template.h"
-#endif /* CONFIG_ATOMIC128 */
+#endif /* HAVE_CMPXCHG128 */
+
+abi_ulong vdso_text_start;
+
+/* Store a pair of abi_longs, i.e. a struct timespec or timeval.  */
+static void vdso_put_pair(CPUArchState *env, target_ulong addr,
+                          abi_long a, abi_long b, uintptr_t ra)
+{
+    if (sizeof(abi_long) == 8) {
+        cpu_stq_data_ra(env, addr, a, ra);
+        cpu_stq_data_ra(env, addr + 8, b, ra);
+    } else {
+        cpu_stl_data_ra(env, addr, a, ra);
+        cpu_stl_data_ra(env, addr + 4, b, ra);
+    }
+}
+
+/* The fast path of the vDSO entry points: read the host clocks and
+ * write the result straight into guest memory, faulting like the real
+ * vDSO code would on a bad pointer.  Clock ids and errno values are
+ * the same for every Linux architecture, so neither is translated.
+ */
+target_ulong HELPER(vdso_call)(CPUArchState *env, uint32_t entry,
+                               target_ulong arg0, target_ulong arg1)
+{
+    uintptr_t ra = GETPC();
+    struct timespec ts;
+    struct timeval tv;
+    struct timezone tz;
+    time_t t;
+
+    switch (entry) {
+    case VDSO_CLOCK_GETTIME:
+        if (clock_gettime((int32_t)arg0, &ts) < 0) {
+            return -errno;
+        }
+        vdso_put_pair(env, arg1, ts.tv_sec, ts.tv_nsec, ra);
+        return 0;
+
+    case VDSO_CLOCK_GETRES:
+        if (clock_getres((int32_t)arg0, &ts) < 0) {
+            return -errno;
+        }
+        if (arg1) {
+            vdso_put_pair(env, arg1, ts.tv_sec, ts.tv_nsec, ra);
+        }
+        return 0;
+
+    case VDSO_GETTIMEOFDAY:
+        gettimeofday(&tv, &tz);
+        if (arg0) {
+            vdso_put_pair(env, arg0, tv.tv_sec, tv.tv_usec, ra);
+        }
+        if (arg1) {
+            cpu_stl_data_ra(env, arg1, tz.tz_minuteswest, ra);
+            cpu_stl_data_ra(env, arg1 + 4, tz.tz_dsttime, ra);
+        }
+        return 0;
+
+    case VDSO_TIME:
+        t = time(NULL);
+        if (arg0) {
+            if (sizeof(abi_long) == 8) {
+                cpu_stq_data_ra(env, arg0, t, ra);
+            } else {
+                cpu_stl_data_ra(env, arg0, t, ra);
+            }
+        }
+        return t;
+
+    default:
+        g_assert_not_reached();
+    }
+}
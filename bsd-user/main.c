@@ -88,7 +88,6 @@ void fork_start(void)
 {
     cpu_list_lock();
     mmap_fork_start();
-    qemu_mutex_lock(&tb_ctx.tb_lock);
 }
 
 void fork_end(int child)
@@ -104,12 +103,10 @@ void fork_end(int child)
                 QTAILQ_REMOVE(&cpus, cpu, node);
             }
         }
-        qemu_mutex_init(&tb_ctx.tb_lock);
         mmap_fork_end(child);
 	qemu_init_cpu_list();
         gdbserver_fork(thread_cpu);
     } else {
-        qemu_mutex_unlock(&tb_ctx.tb_lock);
         mmap_fork_end(child);
 	cpu_list_unlock();
     }
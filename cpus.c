@@ -223,6 +223,9 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    tcg_region_set_evict(qemu_opt_get_bool(opts, "evict", false));
+    tcg_region_set_hugepages(qemu_opt_get_bool(opts, "hugepages", false));
 }
 
 /* The current number of executed instructions is based on what we
@@ -22,13 +22,26 @@
 #include "disas/bfd.h"
 #include "tcg/tcg.h"
 
+/* Superinstructions fused by the TCI backend, see tcg/tci/tcg-target.h. */
+static const char *const tci_superinsn_names[TCI_OP_LAST - TCI_OP_FIRST] = {
+    [TCI_OP_ld_ld - TCI_OP_FIRST] = "ld_ld",
+    [TCI_OP_st_st - TCI_OP_FIRST] = "st_st",
+    [TCI_OP_ld_st - TCI_OP_FIRST] = "ld_st",
+    [TCI_OP_st_ld - TCI_OP_FIRST] = "st_ld",
+    [TCI_OP_ld_add - TCI_OP_FIRST] = "ld_add",
+    [TCI_OP_add_st - TCI_OP_FIRST] = "add_st",
+    [TCI_OP_ld_add_st - TCI_OP_FIRST] = "ld_add_st",
+    [TCI_OP_ld_brcond_i32 - TCI_OP_FIRST] = "ld_brcond_i32",
+    [TCI_OP_movi_st_i32 - TCI_OP_FIRST] = "movi_st_i32",
+};
+
 /* Disassemble TCI bytecode. */
 int print_insn_tci(bfd_vma addr, disassemble_info *info)
 {
     int length;
     uint8_t byte;
     int status;
-    TCGOpcode op;
+    int op;
 
     status = info->read_memory_func(addr, &byte, 1, info);
     if (status != 0) {
@@ -45,7 +58,10 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
     }
     length = byte;
 
-    if (op >= tcg_op_defs_max) {
+    if (op >= TCI_OP_FIRST && op < TCI_OP_LAST) {
+        info->fprintf_func(info->stream, "%s\tsuperinstruction",
+                           tci_superinsn_names[op - TCI_OP_FIRST]);
+    } else if (op >= tcg_op_defs_max) {
         info->fprintf_func(info->stream, "illegal opcode %d", op);
     } else {
         const TCGOpDef *def = &tcg_op_defs[op];
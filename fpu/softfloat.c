@@ -83,6 +83,8 @@ this code that are retained.
  * target-dependent and needs the TARGET_* macros.
  */
 #include "qemu/osdep.h"
+#include <math.h>
+#include <float.h>
 
 #include "fpu/softfloat.h"
 
@@ -105,6 +107,12 @@ this code that are retained.
 *----------------------------------------------------------------------------*/
 #include "softfloat-specialize.h"
 
+/*----------------------------------------------------------------------------
+| The softfloat implementations of the operations that have a hardfloat fast
+| path (see below).  Keep them out of line so that the fast path stays small.
+*----------------------------------------------------------------------------*/
+#define QEMU_SOFTFLOAT_ATTR __attribute__((noinline))
+
 /*----------------------------------------------------------------------------
 | Returns the fraction bits of the half-precision floating-point value `a'.
 *----------------------------------------------------------------------------*/
@@ -2183,7 +2191,8 @@ static float32 subFloat32Sigs(float32 a, float32 b, flag zSign,
 | Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float32 float32_add(float32 a, float32 b, float_status *status)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float32_add(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign;
     a = float32_squash_input_denormal(a, status);
@@ -2206,7 +2215,8 @@ float32 float32_add(float32 a, float32 b, float_status *status)
 | for Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float32 float32_sub(float32 a, float32 b, float_status *status)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float32_sub(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign;
     a = float32_squash_input_denormal(a, status);
@@ -2229,7 +2239,8 @@ float32 float32_sub(float32 a, float32 b, float_status *status)
 | for Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float32 float32_mul(float32 a, float32 b, float_status *status)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float32_mul(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign, zSign;
     int aExp, bExp, zExp;
@@ -2294,7 +2305,8 @@ float32 float32_mul(float32 a, float32 b, float_status *status)
 | IEC/IEEE Standard for Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float32 float32_div(float32 a, float32 b, float_status *status)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float32_div(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign, zSign;
     int aExp, bExp, zExp;
@@ -2692,7 +2704,8 @@ float32 float32_muladd(float32 a, float32 b, float32 c, int flags,
 | Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float32 float32_sqrt(float32 a, float_status *status)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float32_sqrt(float32 a, float_status *status)
 {
     flag aSign;
     int aExp, zExp;
@@ -3978,7 +3991,8 @@ static float64 subFloat64Sigs(float64 a, float64 b, flag zSign,
 | Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float64 float64_add(float64 a, float64 b, float_status *status)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float64_add(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign;
     a = float64_squash_input_denormal(a, status);
@@ -4001,7 +4015,8 @@ float64 float64_add(float64 a, float64 b, float_status *status)
 | for Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float64 float64_sub(float64 a, float64 b, float_status *status)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float64_sub(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign;
     a = float64_squash_input_denormal(a, status);
@@ -4024,7 +4039,8 @@ float64 float64_sub(float64 a, float64 b, float_status *status)
 | for Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float64 float64_mul(float64 a, float64 b, float_status *status)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float64_mul(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign, zSign;
     int aExp, bExp, zExp;
@@ -4087,7 +4103,8 @@ float64 float64_mul(float64 a, float64 b, float_status *status)
 | the IEC/IEEE Standard for Binary Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float64 float64_div(float64 a, float64 b, float_status *status)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float64_div(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign, zSign;
     int aExp, bExp, zExp;
@@ -4500,7 +4517,8 @@ float64 float64_muladd(float64 a, float64 b, float64 c, int flags,
 | Floating-Point Arithmetic.
 *----------------------------------------------------------------------------*/
 
-float64 float64_sqrt(float64 a, float_status *status)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float64_sqrt(float64 a, float_status *status)
 {
     flag aSign;
     int aExp, zExp;
@@ -4548,6 +4566,324 @@ float64 float64_sqrt(float64 a, float_status *status)
 
 }
 
+/*----------------------------------------------------------------------------
+| Hardfloat.
+|
+| For zero or normal inputs rounded to nearest-even, the host FPU computes
+| add, sub, mul, div and sqrt to the same result as softfloat.  What makes
+| the host FPU hard to use is the exception flags: reading them back from
+| the host is slower than softfloat itself.  So we only take the host path
+| when the guest's inexact flag is already raised: it is sticky, so there
+| is no need to detect it again.  The other flags are detected cheaply from
+| the inputs and the result: an infinite result raises overflow, and a tiny
+| result, which may have underflowed, is recomputed with softfloat.  NaN,
+| infinite and denormal inputs, and the other rounding modes, always use
+| softfloat.
+|
+| The fast path needs the host to round float and double operations to their
+| own precision, which x87 does not do, and -ffast-math voids all of this.
+*----------------------------------------------------------------------------*/
+#if defined(__FAST_MATH__) || (defined(__i386__) && !defined(__SSE2_MATH__))
+#define QEMU_HARDFLOAT 0
+#else
+#define QEMU_HARDFLOAT 1
+#endif
+
+typedef union {
+    float32 s;
+    float h;
+} union_float32;
+
+typedef union {
+    float64 s;
+    double h;
+} union_float64;
+
+typedef bool (*f32_check_fn)(union_float32 a, union_float32 b);
+typedef bool (*f64_check_fn)(union_float64 a, union_float64 b);
+
+typedef float32 (*soft_f32_op2_fn)(float32 a, float32 b, float_status *s);
+typedef float64 (*soft_f64_op2_fn)(float64 a, float64 b, float_status *s);
+typedef float (*hard_f32_op2_fn)(float a, float b);
+typedef double (*hard_f64_op2_fn)(double a, double b);
+
+static inline bool can_use_fpu(const float_status *s)
+{
+    return QEMU_HARDFLOAT &&
+        likely(s->float_exception_flags & float_flag_inexact &&
+               s->float_rounding_mode == float_round_nearest_even);
+}
+
+static inline bool f32_is_normal(union_float32 a)
+{
+    int exp = extractFloat32Exp(a.s);
+
+    return exp != 0 && exp != 0xFF;
+}
+
+static inline bool f32_is_zon(union_float32 a)
+{
+    return float32_is_zero(a.s) || f32_is_normal(a);
+}
+
+/*
+ * A result that rounded to exactly +-FLT_MIN may still have been tiny
+ * before rounding, so leave those to softfloat as well.
+ */
+static inline bool f32_is_tiny(union_float32 a)
+{
+    return fabsf(a.h) <= FLT_MIN;
+}
+
+static inline bool f32_is_inf(union_float32 a)
+{
+    return extractFloat32Exp(a.s) == 0xFF;
+}
+
+static inline bool f64_is_normal(union_float64 a)
+{
+    int exp = extractFloat64Exp(a.s);
+
+    return exp != 0 && exp != 0x7FF;
+}
+
+static inline bool f64_is_zon(union_float64 a)
+{
+    return float64_is_zero(a.s) || f64_is_normal(a);
+}
+
+static inline bool f64_is_tiny(union_float64 a)
+{
+    return fabs(a.h) <= DBL_MIN;
+}
+
+static inline bool f64_is_inf(union_float64 a)
+{
+    return extractFloat64Exp(a.s) == 0x7FF;
+}
+
+/* Checks done before the operation: both inputs are zero or normal...  */
+static bool f32_is_zon2(union_float32 a, union_float32 b)
+{
+    return f32_is_zon(a) && f32_is_zon(b);
+}
+
+static bool f64_is_zon2(union_float64 a, union_float64 b)
+{
+    return f64_is_zon(a) && f64_is_zon(b);
+}
+
+/* ...or, for division, the divisor is normal.  */
+static bool f32_div_pre(union_float32 a, union_float32 b)
+{
+    return f32_is_zon(a) && f32_is_normal(b);
+}
+
+static bool f64_div_pre(union_float64 a, union_float64 b)
+{
+    return f64_is_zon(a) && f64_is_normal(b);
+}
+
+/*
+ * Checks done when the result is zero or subnormal: return true if it
+ * may have underflowed, and must be recomputed with softfloat.  A sum is
+ * exact when both addends are zero, a product or quotient when the
+ * (first) operand is.
+ */
+static bool f32_addsub_post(union_float32 a, union_float32 b)
+{
+    return !(float32_is_zero(a.s) && float32_is_zero(b.s));
+}
+
+static bool f64_addsub_post(union_float64 a, union_float64 b)
+{
+    return !(float64_is_zero(a.s) && float64_is_zero(b.s));
+}
+
+static bool f32_mul_post(union_float32 a, union_float32 b)
+{
+    return !(float32_is_zero(a.s) || float32_is_zero(b.s));
+}
+
+static bool f64_mul_post(union_float64 a, union_float64 b)
+{
+    return !(float64_is_zero(a.s) || float64_is_zero(b.s));
+}
+
+static bool f32_div_post(union_float32 a, union_float32 b)
+{
+    return !float32_is_zero(a.s);
+}
+
+static bool f64_div_post(union_float64 a, union_float64 b)
+{
+    return !float64_is_zero(a.s);
+}
+
+static inline float32
+float32_gen2(float32 xa, float32 xb, float_status *s,
+             hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+             f32_check_fn pre, f32_check_fn post)
+{
+    union_float32 ua, ub, ur;
+
+    ua.s = xa;
+    ub.s = xb;
+
+    if (unlikely(!can_use_fpu(s) || !pre(ua, ub))) {
+        return soft(xa, xb, s);
+    }
+
+    ur.h = hard(ua.h, ub.h);
+    if (unlikely(f32_is_inf(ur))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(f32_is_tiny(ur)) && post(ua, ub)) {
+        return soft(xa, xb, s);
+    }
+    return ur.s;
+}
+
+static inline float64
+float64_gen2(float64 xa, float64 xb, float_status *s,
+             hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+             f64_check_fn pre, f64_check_fn post)
+{
+    union_float64 ua, ub, ur;
+
+    ua.s = xa;
+    ub.s = xb;
+
+    if (unlikely(!can_use_fpu(s) || !pre(ua, ub))) {
+        return soft(xa, xb, s);
+    }
+
+    ur.h = hard(ua.h, ub.h);
+    if (unlikely(f64_is_inf(ur))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(f64_is_tiny(ur)) && post(ua, ub)) {
+        return soft(xa, xb, s);
+    }
+    return ur.s;
+}
+
+static float hard_f32_add(float a, float b)
+{
+    return a + b;
+}
+
+static float hard_f32_sub(float a, float b)
+{
+    return a - b;
+}
+
+static float hard_f32_mul(float a, float b)
+{
+    return a * b;
+}
+
+static float hard_f32_div(float a, float b)
+{
+    return a / b;
+}
+
+static double hard_f64_add(double a, double b)
+{
+    return a + b;
+}
+
+static double hard_f64_sub(double a, double b)
+{
+    return a - b;
+}
+
+static double hard_f64_mul(double a, double b)
+{
+    return a * b;
+}
+
+static double hard_f64_div(double a, double b)
+{
+    return a / b;
+}
+
+float32 float32_add(float32 a, float32 b, float_status *status)
+{
+    return float32_gen2(a, b, status, hard_f32_add, soft_float32_add,
+                        f32_is_zon2, f32_addsub_post);
+}
+
+float32 float32_sub(float32 a, float32 b, float_status *status)
+{
+    return float32_gen2(a, b, status, hard_f32_sub, soft_float32_sub,
+                        f32_is_zon2, f32_addsub_post);
+}
+
+float32 float32_mul(float32 a, float32 b, float_status *status)
+{
+    return float32_gen2(a, b, status, hard_f32_mul, soft_float32_mul,
+                        f32_is_zon2, f32_mul_post);
+}
+
+float32 float32_div(float32 a, float32 b, float_status *status)
+{
+    return float32_gen2(a, b, status, hard_f32_div, soft_float32_div,
+                        f32_div_pre, f32_div_post);
+}
+
+float64 float64_add(float64 a, float64 b, float_status *status)
+{
+    return float64_gen2(a, b, status, hard_f64_add, soft_float64_add,
+                        f64_is_zon2, f64_addsub_post);
+}
+
+float64 float64_sub(float64 a, float64 b, float_status *status)
+{
+    return float64_gen2(a, b, status, hard_f64_sub, soft_float64_sub,
+                        f64_is_zon2, f64_addsub_post);
+}
+
+float64 float64_mul(float64 a, float64 b, float_status *status)
+{
+    return float64_gen2(a, b, status, hard_f64_mul, soft_float64_mul,
+                        f64_is_zon2, f64_mul_post);
+}
+
+float64 float64_div(float64 a, float64 b, float_status *status)
+{
+    return float64_gen2(a, b, status, hard_f64_div, soft_float64_div,
+                        f64_div_pre, f64_div_post);
+}
+
+/*
+ * The square root of a positive normal is normal, and that of a zero is
+ * itself, so no flag other than inexact can be raised.
+ */
+float32 float32_sqrt(float32 a, float_status *status)
+{
+    union_float32 ua, ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(status) || !f32_is_zon(ua) ||
+                 (extractFloat32Sign(a) && !float32_is_zero(a)))) {
+        return soft_float32_sqrt(a, status);
+    }
+    ur.h = sqrtf(ua.h);
+    return ur.s;
+}
+
+float64 float64_sqrt(float64 a, float_status *status)
+{
+    union_float64 ua, ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(status) || !f64_is_zon(ua) ||
+                 (extractFloat64Sign(a) && !float64_is_zero(a)))) {
+        return soft_float64_sqrt(a, status);
+    }
+    ur.h = sqrt(ua.h);
+    return ur.s;
+}
+
 /*----------------------------------------------------------------------------
 | Returns the binary log of the double-precision floating-point value `a'.
 | The operation is performed according to the IEC/IEEE Standard for Binary
@@ -276,7 +276,8 @@ ETEXI
 STEXI
 @item info jit
 @findex info jit
-Show dynamic compiler info.
+Show dynamic compiler info.  If the @code{hot_tbs} log item is enabled,
+also list the most frequently executed translation blocks.
 ETEXI
 
 #if defined(CONFIG_TCG)
@@ -284,7 +285,7 @@ ETEXI
         .name       = "opcount",
         .args_type  = "",
         .params     = "",
-        .help       = "show dynamic compiler opcode counters",
+        .help       = "show dynamic compiler instruction and opcode counters",
         .cmd        = hmp_info_opcount,
     },
 #endif
@@ -292,7 +293,11 @@ ETEXI
 STEXI
 @item info opcount
 @findex info opcount
-Show dynamic compiler opcode counters
+Show dynamic compiler opcode counters.  With the @code{insn_stats} or
+@code{insn_exec} log items enabled, also show how many guest instructions of
+each class were translated (and executed), and how many TCG ops and bytes of
+host code they produced on average.  With @code{insn_exec}, the host code
+includes the execution counters.
 ETEXI
 
     {
@@ -161,6 +161,37 @@ extern unsigned long reserved_va;
 
 #define GUEST_ADDR_MAX (reserved_va ? reserved_va : \
                                     (1ul << TARGET_VIRT_ADDR_SPACE_BITS) - 1)
+
+/* Entry points of the emulated vDSO.  Entry N starts at
+ * vdso_text_start + N * VDSO_ENTRY_SIZE with the system call that a
+ * real vDSO would fall back to; the translator replaces that system
+ * call with a direct call to helper_vdso_call.
+ */
+enum {
+    VDSO_CLOCK_GETTIME,
+    VDSO_GETTIMEOFDAY,
+    VDSO_TIME,
+    VDSO_CLOCK_GETRES,
+    VDSO_NB_ENTRIES
+};
+
+#define VDSO_ENTRY_SIZE 16
+
+/* Zero if no vDSO has been mapped.  */
+extern abi_ulong vdso_text_start;
+
+/* Return the vDSO entry point starting at @pc, or -1 if there is none.  */
+static inline int vdso_entry(target_ulong pc)
+{
+    target_ulong ofs = pc - vdso_text_start;
+
+    if (likely(vdso_text_start == 0
+               || ofs >= VDSO_NB_ENTRIES * VDSO_ENTRY_SIZE
+               || ofs % VDSO_ENTRY_SIZE)) {
+        return -1;
+    }
+    return ofs / VDSO_ENTRY_SIZE;
+}
 #else
 
 #include "exec/hwaddr.h"
@@ -263,6 +294,10 @@ int walk_memory_regions(void *, walk_memory_regions_fn);
 int page_get_flags(target_ulong address);
 void page_set_flags(target_ulong start, target_ulong end, int flags);
 int page_check_range(target_ulong start, target_ulong len, int flags);
+target_ulong page_find_range_empty(target_ulong min, target_ulong max,
+                                   target_ulong len, target_ulong align);
+void page_flags_fork_start(void);
+void page_flags_fork_end(int child);
 #endif
 
 CPUArchState *cpu_copy(CPUArchState *env);
@@ -340,9 +375,10 @@ CPUArchState *cpu_copy(CPUArchState *env);
 #define TLB_FLAGS_MASK  (TLB_INVALID_MASK | TLB_NOTDIRTY | TLB_MMIO)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf);
-void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf);
 #endif /* !CONFIG_USER_ONLY */
 
+void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf);
+
 int cpu_memory_rw_debug(CPUState *cpu, target_ulong addr,
                         uint8_t *buf, int len, int is_write);
 
@@ -24,6 +24,7 @@
 #endif
 
 #include "qemu/host-utils.h"
+#include "qemu/thread.h"
 #include "qemu/queue.h"
 #ifdef CONFIG_TCG
 #include "tcg-target.h"
@@ -66,6 +67,27 @@ typedef uint64_t target_ulong;
 #define CPU_TLB_ENTRY_BITS 5
 #endif
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* The size of each TLB is chosen at run time, between these bounds.  */
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
+
+# if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#  define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+# else /* HOST_LONG_BITS == 64 */
+/*
+ * Assuming TARGET_PAGE_BITS==12, with 2**22 entries we can cover 2**(22+12) ==
+ * 2**34 == 16G of address space, which is in the same ballpark as the
+ * second-level TLB of current x86 hosts when huge pages are included.
+ * Also, make sure we do not size the TLB past the guest's address space.
+ */
+#  define CPU_TLB_DYN_MAX_BITS                                  \
+    MIN(22, TARGET_VIRT_ADDR_SPACE_BITS - TARGET_PAGE_BITS)
+# endif
+
+#else /* !TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 /* TCG_TARGET_TLB_DISPLACEMENT_BITS is used in CPU_TLB_BITS to ensure that
  * the TLB is not unnecessarily small, but still small enough for the
  * TLB lookup instruction sequence used by the TCG target.
@@ -97,6 +119,7 @@ typedef uint64_t target_ulong;
          NB_MMU_MODES <= 8 ? 3 : 4))
 
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
 
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
@@ -131,11 +154,37 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* Bookkeeping for the resizing of one TLB, see tlb_mmu_resize_locked.  */
+typedef struct CPUTLBDesc {
+    /* start of the current usage window and peak usage within it */
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    /* number of valid entries in tlb_table */
+    size_t n_used_entries;
+} CPUTLBDesc;
+
+#define CPU_COMMON_TLB_TABLES                                           \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
+    /* tlb_mask[i] contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */    \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];                                 \
+
+#else
+#define CPU_COMMON_TLB_TABLES                                           \
+    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
+
+#endif
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    /* tlb_lock serializes resizing with tlb_reset_dirty from other   */ \
+    /* vCPUs; the owning vCPU thread may read the tables without it.  */ \
+    QemuSpin tlb_lock;                                                  \
+    CPU_COMMON_TLB_TABLES                                               \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
-    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
     size_t tlb_flush_count;                                             \
     target_ulong tlb_flush_addr;                                        \
@@ -149,8 +198,27 @@ typedef struct CPUIOTLBEntry {
 #endif
 
 
+/* Return address stack: for each guest call not yet returned from, the
+ * return address and the tb_jmp_cache slot of the TB expected there.
+ * Entries are only predictions and are validated when they are used.
+ */
+#define CPU_RAS_BITS 4
+#define CPU_RAS_SIZE (1 << CPU_RAS_BITS)
+
+typedef struct CPURASEntry {
+    target_ulong pc;
+    /* offset of the tb_jmp_cache slot for pc from env */
+    int32_t jmp_cache_ofs;
+} CPURASEntry;
+
+#define CPU_COMMON_RAS                                                  \
+    /* offset of the top entry in ras */                                \
+    uint32_t ras_top;                                                   \
+    CPURASEntry ras[CPU_RAS_SIZE];                                      \
+
 #define CPU_COMMON                                                      \
     /* soft mmu support */                                              \
     CPU_COMMON_TLB                                                      \
+    CPU_COMMON_RAS                                                      \
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef GEN_ICOUNT_H
 #define GEN_ICOUNT_H
 
+#include "qemu/log.h"
 #include "qemu/timer.h"
 
 /* Helpers for instruction counting code generation.  */
@@ -41,6 +42,17 @@ static inline void gen_tb_start(TranslationBlock *tb)
     }
 
     tcg_temp_free_i32(count);
+
+    if (qemu_loglevel_mask(CPU_LOG_TB_HOT)) {
+        TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+        TCGv_i64 n = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(n, ptr, 0);
+        tcg_gen_addi_i64(n, n, 1);
+        tcg_gen_st_i64(n, ptr, 0);
+        tcg_temp_free_i64(n);
+        tcg_temp_free_ptr(ptr);
+    }
 }
 
 static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
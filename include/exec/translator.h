@@ -59,6 +59,9 @@ typedef enum DisasJumpType {
  * @is_jmp: What instruction to disassemble next.
  * @num_insns: Number of translated instructions (including current).
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @insn_class: Class of the current instruction, for the statistics of
+ *              translator_register_insn_classes().  Reset to 0 before
+ *              each call to #TranslatorOps.translate_insn.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -69,6 +72,7 @@ typedef struct DisasContextBase {
     DisasJumpType is_jmp;
     unsigned int num_insns;
     bool singlestep_enabled;
+    unsigned int insn_class;
 } DisasContextBase;
 
 /**
@@ -141,4 +145,26 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_register_insn_classes:
+ * @names: Name of each instruction class.
+ * @n: Number of instruction classes.
+ *
+ * Enable per-class instruction statistics (-d insn_stats and -d insn_exec)
+ * for this target.  #TranslatorOps.translate_insn stores the class of each
+ * instruction, below @n, in db->insn_class.
+ */
+void translator_register_insn_classes(const char * const *names, unsigned n);
+
+/**
+ * translator_account_insn_stats:
+ * @s: TCG context.
+ * @tb: Translation block just generated by tcg_gen_code().
+ *
+ * Add the instructions of @tb to the per-class translation statistics.
+ */
+void translator_account_insn_stats(TCGContext *s, TranslationBlock *tb);
+
+void translator_dump_insn_stats(FILE *f, fprintf_function cpu_fprintf);
+
 #endif  /* EXEC__TRANSLATOR_H */
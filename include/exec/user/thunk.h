@@ -56,6 +56,8 @@ typedef struct {
     int size[2];
     int align[2];
     const char *name;
+    /* target and host layouts are identical: convert with memcpy */
+    bool same_layout;
 } StructEntry;
 
 /* Translation table for bitmasks... */
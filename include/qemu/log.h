@@ -43,6 +43,9 @@ static inline bool qemu_log_separate(void)
 #define CPU_LOG_PAGE       (1 << 14)
 #define LOG_TRACE          (1 << 15)
 #define CPU_LOG_TB_OP_IND  (1 << 16)
+#define CPU_LOG_TB_HOT     (1 << 17)
+#define CPU_LOG_INSN_STATS (1 << 18)
+#define CPU_LOG_INSN_EXEC  (1 << 19)
 
 /* Returns true if a bit is set in the current loglevel mask
  */
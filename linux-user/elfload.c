@@ -7,6 +7,7 @@
 #include "qemu.h"
 #include "disas/disas.h"
 #include "qemu/path.h"
+#include "perf.h"
 
 #ifdef _ARCH_PPC64
 #undef ARCH_DLINFO
@@ -189,6 +190,32 @@ static void elf_core_copy_regs(target_elf_gregset_t *regs, const CPUX86State *en
     (*regs)[26] = env->segs[R_GS].selector & 0xffff;
 }
 
+#define HAVE_VDSO
+
+static const char * const vdso_names[VDSO_NB_ENTRIES] = {
+    [VDSO_CLOCK_GETTIME] = "__vdso_clock_gettime",
+    [VDSO_GETTIMEOFDAY] = "__vdso_gettimeofday",
+    [VDSO_TIME] = "__vdso_time",
+    [VDSO_CLOCK_GETRES] = "__vdso_clock_getres",
+};
+
+static const int vdso_syscalls[VDSO_NB_ENTRIES] = {
+    [VDSO_CLOCK_GETTIME] = TARGET_NR_clock_gettime,
+    [VDSO_GETTIMEOFDAY] = TARGET_NR_gettimeofday,
+    [VDSO_TIME] = TARGET_NR_time,
+    [VDSO_CLOCK_GETRES] = TARGET_NR_clock_getres,
+};
+
+/* mov $nr, %eax; syscall; ret */
+static void vdso_fill_entry(uint8_t *p, int nr)
+{
+    p[0] = 0xb8;
+    stl_le_p(p + 1, nr);
+    p[5] = 0x0f;
+    p[6] = 0x05;
+    p[7] = 0xc3;
+}
+
 #else
 
 #define ELF_START_MMAP 0x80000000
@@ -537,6 +564,28 @@ static uint32_t get_elf_hwcap(void)
     return hwcaps;
 }
 
+#define HAVE_VDSO
+
+static const char * const vdso_names[VDSO_NB_ENTRIES] = {
+    [VDSO_CLOCK_GETTIME] = "__kernel_clock_gettime",
+    [VDSO_GETTIMEOFDAY] = "__kernel_gettimeofday",
+    [VDSO_CLOCK_GETRES] = "__kernel_clock_getres",
+};
+
+static const int vdso_syscalls[VDSO_NB_ENTRIES] = {
+    [VDSO_CLOCK_GETTIME] = TARGET_NR_clock_gettime,
+    [VDSO_GETTIMEOFDAY] = TARGET_NR_gettimeofday,
+    [VDSO_CLOCK_GETRES] = TARGET_NR_clock_getres,
+};
+
+/* mov x8, #nr; svc #0; ret */
+static void vdso_fill_entry(uint8_t *p, int nr)
+{
+    stl_le_p(p, 0xd2800008 | (nr << 5));
+    stl_le_p(p + 4, 0xd4000001);
+    stl_le_p(p + 8, 0xd65f03c0);
+}
+
 #endif /* not TARGET_AARCH64 */
 #endif /* TARGET_ARM */
 
@@ -1649,6 +1698,137 @@ static abi_ulong loader_build_fdpic_loadmap(struct image_info *info, abi_ulong s
 }
 #endif
 
+#ifdef HAVE_VDSO
+/* Build and map a vDSO exporting the entry points in vdso_names[].
+ * Each entry is a plain system call stub, so the image is a valid
+ * vDSO on its own; the translators then replace the system calls
+ * with direct helper calls (see vdso_entry()).  Return the load
+ * address of the image, or 0 if it could not be mapped.
+ */
+static abi_ulong load_vdso(void)
+{
+    const int ndyn = 7;
+    int nsyms = 1, strsz = sizeof("linux-vdso.so.1") + 1;
+    size_t ofs_phdr, ofs_dyn, ofs_hash, ofs_sym, ofs_str, ofs_text, size;
+    struct elfhdr *ehdr;
+    struct elf_phdr *phdr;
+    ElfW(Dyn) *dyn;
+    uint32_t *hash;
+    struct elf_sym *sym;
+    char *str;
+    uint8_t *image;
+    abi_ulong addr;
+    int i;
+
+    for (i = 0; i < VDSO_NB_ENTRIES; i++) {
+        if (vdso_names[i]) {
+            nsyms++;
+            strsz += strlen(vdso_names[i]) + 1;
+        }
+    }
+
+    ofs_phdr = sizeof(struct elfhdr);
+    ofs_dyn = ofs_phdr + 2 * sizeof(struct elf_phdr);
+    ofs_hash = ofs_dyn + ndyn * sizeof(ElfW(Dyn));
+    ofs_sym = QEMU_ALIGN_UP(ofs_hash + (3 + nsyms) * 4, sizeof(elf_addr_t));
+    ofs_str = ofs_sym + nsyms * sizeof(struct elf_sym);
+    ofs_text = QEMU_ALIGN_UP(ofs_str + strsz, VDSO_ENTRY_SIZE);
+    size = ofs_text + VDSO_NB_ENTRIES * VDSO_ENTRY_SIZE;
+    assert(size <= TARGET_PAGE_SIZE);
+
+    image = g_malloc0(size);
+    ehdr = (struct elfhdr *)image;
+    phdr = (struct elf_phdr *)(image + ofs_phdr);
+    dyn = (ElfW(Dyn) *)(image + ofs_dyn);
+    hash = (uint32_t *)(image + ofs_hash);
+    sym = (struct elf_sym *)(image + ofs_sym);
+    str = (char *)image + ofs_str;
+
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELF_CLASS;
+    ehdr->e_ident[EI_DATA] = ELF_DATA;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_ident[EI_OSABI] = ELF_OSABI;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = ELF_MACHINE;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_phoff = ofs_phdr;
+    ehdr->e_ehsize = sizeof(struct elfhdr);
+    ehdr->e_phentsize = sizeof(struct elf_phdr);
+    ehdr->e_phnum = 2;
+    bswap_ehdr(ehdr);
+
+    phdr[0].p_type = PT_LOAD;
+    phdr[0].p_flags = PF_R | PF_X;
+    phdr[0].p_filesz = size;
+    phdr[0].p_memsz = size;
+    phdr[0].p_align = TARGET_PAGE_SIZE;
+    phdr[1].p_type = PT_DYNAMIC;
+    phdr[1].p_flags = PF_R;
+    phdr[1].p_offset = ofs_dyn;
+    phdr[1].p_vaddr = ofs_dyn;
+    phdr[1].p_paddr = ofs_dyn;
+    phdr[1].p_filesz = ndyn * sizeof(ElfW(Dyn));
+    phdr[1].p_memsz = ndyn * sizeof(ElfW(Dyn));
+    phdr[1].p_align = sizeof(elf_addr_t);
+    bswap_phdr(phdr, 2);
+
+    /* DT_NULL is left zero.  */
+    dyn[0].d_tag = tswapl(DT_SONAME);
+    dyn[0].d_un.d_val = tswapl(1);
+    dyn[1].d_tag = tswapl(DT_HASH);
+    dyn[1].d_un.d_ptr = tswapl(ofs_hash);
+    dyn[2].d_tag = tswapl(DT_SYMTAB);
+    dyn[2].d_un.d_ptr = tswapl(ofs_sym);
+    dyn[3].d_tag = tswapl(DT_SYMENT);
+    dyn[3].d_un.d_val = tswapl(sizeof(struct elf_sym));
+    dyn[4].d_tag = tswapl(DT_STRTAB);
+    dyn[4].d_un.d_ptr = tswapl(ofs_str);
+    dyn[5].d_tag = tswapl(DT_STRSZ);
+    dyn[5].d_un.d_val = tswapl(strsz);
+
+    /* A single hash bucket chaining all the symbols together.  */
+    hash[0] = tswap32(1);
+    hash[1] = tswap32(nsyms);
+    hash[2] = tswap32(nsyms - 1);
+    for (i = 1; i < nsyms; i++) {
+        hash[3 + i] = tswap32(i - 1);
+    }
+
+    strcpy(str + 1, "linux-vdso.so.1");
+    strsz = sizeof("linux-vdso.so.1") + 1;
+    for (i = 0, nsyms = 1; i < VDSO_NB_ENTRIES; i++) {
+        if (!vdso_names[i]) {
+            continue;
+        }
+        vdso_fill_entry(image + ofs_text + i * VDSO_ENTRY_SIZE,
+                        vdso_syscalls[i]);
+        strcpy(str + strsz, vdso_names[i]);
+        sym[nsyms].st_name = strsz;
+        sym[nsyms].st_info = ELF_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym[nsyms].st_shndx = 1;
+        sym[nsyms].st_value = ofs_text + i * VDSO_ENTRY_SIZE;
+        sym[nsyms].st_size = VDSO_ENTRY_SIZE;
+        bswap_sym(&sym[nsyms]);
+        strsz += strlen(vdso_names[i]) + 1;
+        nsyms++;
+    }
+
+    addr = target_mmap(0, TARGET_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == -1) {
+        g_free(image);
+        return 0;
+    }
+    memcpy_to_target(addr, image, size);
+    target_mprotect(addr, TARGET_PAGE_SIZE, PROT_READ | PROT_EXEC);
+    g_free(image);
+
+    vdso_text_start = addr + ofs_text;
+    return addr;
+}
+#endif
+
 static abi_ulong create_elf_tables(abi_ulong p, int argc, int envc,
                                    struct elfhdr *exec,
                                    struct image_info *info,
@@ -1732,6 +1912,9 @@ static abi_ulong create_elf_tables(abi_ulong p, int argc, int envc,
 #ifdef ELF_HWCAP2
     size += 2;
 #endif
+    if (info->vdso) {
+        size += 2;
+    }
     info->auxv_len = size * n;
 
     size += envc + argc + 2;
@@ -1795,6 +1978,9 @@ static abi_ulong create_elf_tables(abi_ulong p, int argc, int envc,
     if (u_platform) {
         NEW_AUX_ENT(AT_PLATFORM, u_platform);
     }
+    if (info->vdso) {
+        NEW_AUX_ENT(AT_SYSINFO_EHDR, info->vdso);
+    }
     NEW_AUX_ENT (AT_NULL, 0);
 #undef NEW_AUX_ENT
 
@@ -2178,7 +2364,7 @@ static void load_elf_image(const char *image_name, int image_fd,
         info->brk = info->end_code;
     }
 
-    if (qemu_log_enabled()) {
+    if (qemu_log_enabled() || perf_enabled()) {
         load_symbols(ehdr, image_fd, load_bias);
     }
 
@@ -2447,6 +2633,10 @@ int load_elf_binary(struct linux_binprm *bprm, struct image_info *info)
         }
     }
 
+#ifdef HAVE_VDSO
+    info->vdso = load_vdso();
+#endif
+
     bprm->p = create_elf_tables(bprm->p, bprm->argc, bprm->envc, &elf_ex,
                                 info, (elf_interpreter ? &interp_info : NULL));
     info->start_stack = bprm->p;
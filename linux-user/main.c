@@ -35,6 +35,7 @@
 #include "elf.h"
 #include "exec/log.h"
 #include "trace/control.h"
+#include "perf.h"
 
 char *exec_path;
 
@@ -129,7 +130,6 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
-    qemu_mutex_lock(&tb_ctx.tb_lock);
     cpu_list_lock();
 }
 
@@ -145,14 +145,15 @@ void fork_end(int child)
                 QTAILQ_REMOVE(&cpus, cpu, node);
             }
         }
-        qemu_mutex_init(&tb_ctx.tb_lock);
         qemu_init_cpu_list();
         gdbserver_fork(thread_cpu);
+        if (do_syscall_stats) {
+            syscall_stats_fork_child();
+        }
         /* qemu_init_cpu_list() takes care of reinitializing the
          * exclusive state, so we don't need to end_exclusive() here.
          */
     } else {
-        qemu_mutex_unlock(&tb_ctx.tb_lock);
         cpu_list_unlock();
         end_exclusive();
     }
@@ -4066,6 +4067,38 @@ static void handle_arg_strace(const char *arg)
     do_strace = 1;
 }
 
+static void handle_arg_syscall_stats(const char *arg)
+{
+    if (!strcmp(arg, "table")) {
+        do_syscall_stats = SYSCALL_STATS_TABLE;
+    } else if (!strcmp(arg, "json")) {
+        do_syscall_stats = SYSCALL_STATS_JSON;
+    } else {
+        fprintf(stderr, "Invalid syscall statistics format: %s\n", arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_perfmap(const char *arg)
+{
+    perf_enable_perfmap();
+}
+
+static void handle_arg_jitdump(const char *arg)
+{
+    perf_enable_jitdump();
+}
+
+static void handle_arg_tb_evict(const char *arg)
+{
+    tcg_region_set_evict(true);
+}
+
+static void handle_arg_tb_hugepages(const char *arg)
+{
+    tcg_region_set_hugepages(true);
+}
+
 static void handle_arg_version(const char *arg)
 {
     printf("qemu-" TARGET_NAME " version " QEMU_VERSION QEMU_PKGVERSION
@@ -4127,10 +4160,21 @@ static const struct qemu_argument arg_table[] = {
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"syscall-stats", "QEMU_SYSCALL_STATS", true, handle_arg_syscall_stats,
+     "table|json", "count and time system calls, print them at exit "
+     "and on SIGUSR2"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_randseed,
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
      "",           "[[enable=]<pattern>][,events=<file>][,file=<file>]"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "Generate a /tmp/perf-${pid}.map file for perf"},
+    {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
+     "",           "Generate a jit-${pid}.dump file for perf"},
+    {"tb-evict",   "QEMU_TB_EVICT",    false, handle_arg_tb_evict,
+     "",           "evict translations one region at a time when full"},
+    {"tb-hugepages", "QEMU_TB_HUGEPAGES", false, handle_arg_tb_hugepages,
+     "",           "align the translation buffer for huge pages"},
     {"version",    "QEMU_VERSION",     false, handle_arg_version,
      "",           "display version information and exit"},
     {NULL, NULL, false, NULL, NULL, NULL}
@@ -52,10 +52,12 @@ void mmap_fork_start(void)
     if (mmap_lock_count)
         abort();
     pthread_mutex_lock(&mmap_mutex);
+    page_flags_fork_start();
 }
 
 void mmap_fork_end(int child)
 {
+    page_flags_fork_end(child);
     if (child)
         pthread_mutex_init(&mmap_mutex, NULL);
     else
@@ -204,10 +206,8 @@ unsigned long last_brk;
    of guest address space.  */
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
 {
-    abi_ulong addr;
+    target_ulong addr;
     abi_ulong end_addr;
-    int prot;
-    int looped = 0;
 
     if (size > reserved_va) {
         return (abi_ulong)-1;
@@ -218,26 +218,16 @@ static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
     if (end_addr > reserved_va) {
         end_addr = reserved_va;
     }
-    addr = end_addr - qemu_host_page_size;
 
-    while (1) {
-        if (addr > end_addr) {
-            if (looped) {
-                return (abi_ulong)-1;
-            }
-            end_addr = reserved_va;
-            addr = end_addr - qemu_host_page_size;
-            looped = 1;
-            continue;
-        }
-        prot = page_get_flags(addr);
-        if (prot) {
-            end_addr = addr;
-        }
-        if (addr && addr + size == end_addr) {
-            break;
-        }
-        addr -= qemu_host_page_size;
+    /* Look below the hint first, then anywhere; never at address 0.  */
+    addr = page_find_range_empty(qemu_host_page_size, end_addr - 1,
+                                 size, qemu_host_page_size);
+    if (addr == (target_ulong)-1 && end_addr != reserved_va) {
+        addr = page_find_range_empty(qemu_host_page_size, reserved_va - 1,
+                                     size, qemu_host_page_size);
+    }
+    if (addr == (target_ulong)-1) {
+        return (abi_ulong)-1;
     }
 
     if (start == mmap_next_start) {
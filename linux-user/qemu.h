@@ -51,6 +51,7 @@ struct image_info {
         abi_ulong       arg_strings;
         abi_ulong       env_strings;
         abi_ulong       file_string;
+        abi_ulong       vdso;
         uint32_t        elf_flags;
 	int		personality;
 #ifdef CONFIG_USE_FDPIC
@@ -359,6 +360,7 @@ extern long safe_syscall_base(int *pending, long number, ...);
 
 /* syscall.c */
 int host_to_target_waitstatus(int status);
+void preexit_cleanup(CPUArchState *env, int code);
 
 /* strace.c */
 void print_syscall(int num,
@@ -375,8 +377,21 @@ void print_syscall_ret(int num, abi_long arg1);
  * --- SIGSEGV {si_signo=SIGSEGV, si_code=SI_KERNEL, si_addr=0} ---
  */
 void print_taken_signal(int target_signum, const target_siginfo_t *tinfo);
+const char *syscall_name(int num);
 extern int do_strace;
 
+/* syscall-stats.c */
+enum {
+    SYSCALL_STATS_TABLE = 1,
+    SYSCALL_STATS_JSON,
+};
+
+extern int do_syscall_stats;
+void syscall_stats_record(int num, abi_long ret, int64_t time_ns);
+void syscall_stats_thread_exit(void);
+void syscall_stats_fork_child(void);
+void syscall_stats_dump(void);
+
 /* signal.c */
 void process_pending_signals(CPUArchState *cpu_env);
 void signal_init(void);
@@ -465,6 +465,11 @@ static int core_dump_signal(int sig)
     }
 }
 
+static void syscall_stats_signal_handler(int host_signum)
+{
+    syscall_stats_dump();
+}
+
 void signal_init(void)
 {
     TaskState *ts = (TaskState *)thread_cpu->opaque;
@@ -510,6 +515,15 @@ void signal_init(void)
         if (fatal_signal (i))
             sigaction(host_sig, &act, NULL);
     }
+
+    /* With -syscall-stats, SIGUSR2 prints the statistics and is never
+       seen by the guest.  SA_RESTART keeps it from interrupting the
+       guest's blocking system calls.  */
+    if (do_syscall_stats) {
+        act.sa_flags = SA_RESTART;
+        act.sa_handler = syscall_stats_signal_handler;
+        sigaction(SIGUSR2, &act, NULL);
+    }
 }
 
 #ifndef TARGET_UNICORE32
@@ -795,7 +809,8 @@ int do_sigaction(int sig, const struct target_sigaction *act,
 
         /* we update the host linux signal state */
         host_sig = target_to_host_signal(sig);
-        if (host_sig != SIGSEGV && host_sig != SIGBUS) {
+        if (host_sig != SIGSEGV && host_sig != SIGBUS
+            && !(host_sig == SIGUSR2 && do_syscall_stats)) {
             sigfillset(&act1.sa_mask);
             act1.sa_flags = SA_SIGINFO;
             if (k->sa_flags & TARGET_SA_RESTART)
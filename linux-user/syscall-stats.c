@@ -0,0 +1,287 @@
+/*
+ *  Per-syscall call counts and host time
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qemu/osdep.h"
+#include <sched.h>
+#include "qemu/queue.h"
+#include "qemu/atomic.h"
+
+#include "qemu.h"
+
+int do_syscall_stats;
+
+/* Enough for every syscall of any target; the numbers themselves are
+ * sparse on some targets (e.g. MIPS starts at 4000), so they are
+ * hashed with linear probing.  The numbers come from the guest, so
+ * once the slots are full any further number is counted in one extra
+ * "other" slot.
+ */
+#define SYSCALL_STATS_SLOTS 1024
+#define SYSCALL_STATS_OTHER INT_MIN
+
+typedef struct SyscallStat {
+    int num;
+    uint64_t calls;
+    uint64_t time_ns;
+    uint64_t efault;
+    uint64_t eintr;
+    uint64_t restarts;
+} SyscallStat;
+
+/* Each thread only ever updates its own table, so that recording is
+ * just a few unlocked increments; dumps sum up the tables of all the
+ * threads.  An exiting thread adds its counts to syscall_stats_exited
+ * and frees its table.
+ */
+typedef struct SyscallStatsTable {
+    QLIST_ENTRY(SyscallStatsTable) next;
+    SyscallStat stat[SYSCALL_STATS_SLOTS + 1];
+} SyscallStatsTable;
+
+static QLIST_HEAD(, SyscallStatsTable) syscall_stats_tables;
+static __thread SyscallStatsTable *syscall_stats_table;
+static SyscallStatsTable syscall_stats_exited;
+
+/* syscall_stats_dump also runs in the SIGUSR2 handler, so it sums into
+ * a static table rather than allocating one.
+ */
+static SyscallStatsTable syscall_stats_sum;
+
+/* Protects the list of tables.  The signal handler cannot wait for it,
+ * since it may have interrupted the holder, so a dump that finds it
+ * taken is dropped; everybody else spins.
+ */
+static int syscall_stats_busy;
+
+static void syscall_stats_lock(void)
+{
+    while (atomic_xchg(&syscall_stats_busy, 1)) {
+        sched_yield();
+    }
+}
+
+static void syscall_stats_unlock(void)
+{
+    atomic_set(&syscall_stats_busy, 0);
+}
+
+static SyscallStat *syscall_stat_lookup(SyscallStatsTable *t, int num)
+{
+    unsigned i = (unsigned)num % SYSCALL_STATS_SLOTS;
+    int n;
+
+    if (num != SYSCALL_STATS_OTHER) {
+        for (n = 0; n < SYSCALL_STATS_SLOTS; n++) {
+            if (!t->stat[i].calls || t->stat[i].num == num) {
+                t->stat[i].num = num;
+                return &t->stat[i];
+            }
+            i = (i + 1) % SYSCALL_STATS_SLOTS;
+        }
+    }
+    t->stat[SYSCALL_STATS_SLOTS].num = SYSCALL_STATS_OTHER;
+    return &t->stat[SYSCALL_STATS_SLOTS];
+}
+
+/* Add the counts of SRC to DST.  */
+static void syscall_stats_add(SyscallStatsTable *dst, SyscallStatsTable *src)
+{
+    int i;
+
+    for (i = 0; i <= SYSCALL_STATS_SLOTS; i++) {
+        SyscallStat *s = &src->stat[i];
+        SyscallStat *d;
+
+        if (!s->calls) {
+            continue;
+        }
+        d = syscall_stat_lookup(dst, s->num);
+        d->calls += s->calls;
+        d->time_ns += s->time_ns;
+        d->efault += s->efault;
+        d->eintr += s->eintr;
+        d->restarts += s->restarts;
+    }
+}
+
+void syscall_stats_record(int num, abi_long ret, int64_t time_ns)
+{
+    SyscallStatsTable *t = syscall_stats_table;
+    SyscallStat *s;
+
+    if (unlikely(!t)) {
+        t = g_new0(SyscallStatsTable, 1);
+        syscall_stats_table = t;
+        syscall_stats_lock();
+        QLIST_INSERT_HEAD(&syscall_stats_tables, t, next);
+        syscall_stats_unlock();
+    }
+
+    s = syscall_stat_lookup(t, num);
+    s->calls++;
+    s->time_ns += time_ns;
+    if (ret == -TARGET_EFAULT) {
+        s->efault++;
+    } else if (ret == -TARGET_EINTR) {
+        s->eintr++;
+    } else if (ret == -TARGET_ERESTARTSYS) {
+        s->restarts++;
+    }
+}
+
+void syscall_stats_thread_exit(void)
+{
+    SyscallStatsTable *t = syscall_stats_table;
+
+    if (!t) {
+        return;
+    }
+    syscall_stats_lock();
+    syscall_stats_add(&syscall_stats_exited, t);
+    QLIST_REMOVE(t, next);
+    syscall_stats_unlock();
+    syscall_stats_table = NULL;
+    g_free(t);
+}
+
+void syscall_stats_fork_child(void)
+{
+    SyscallStatsTable *t, *tmp;
+
+    /* The parent's threads are gone, and so are their system calls.  */
+    QLIST_FOREACH_SAFE(t, &syscall_stats_tables, next, tmp) {
+        if (t != syscall_stats_table) {
+            g_free(t);
+        }
+    }
+    QLIST_INIT(&syscall_stats_tables);
+    if (syscall_stats_table) {
+        memset(syscall_stats_table, 0, sizeof(*syscall_stats_table));
+        QLIST_INSERT_HEAD(&syscall_stats_tables, syscall_stats_table, next);
+    }
+    memset(&syscall_stats_exited, 0, sizeof(syscall_stats_exited));
+    syscall_stats_unlock();
+}
+
+static bool syscall_stat_before(const SyscallStat *sa, const SyscallStat *sb)
+{
+    if (sa->time_ns != sb->time_ns) {
+        return sa->time_ns > sb->time_ns;
+    }
+    return sa->num < sb->num;
+}
+
+/* The signal handler may have interrupted a thread inside stdio, so
+ * format each line on the stack and write it to fd 2 directly.
+ */
+static void GCC_FMT_ATTR(1, 2) syscall_stats_printf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    len = MIN(len, sizeof(buf) - 1);
+    if (qemu_write_full(STDERR_FILENO, buf, len) != len) {
+        /* there is nowhere else to report it */
+    }
+}
+
+static const char *syscall_stat_name(int num)
+{
+    return num == SYSCALL_STATS_OTHER ? "other" : syscall_name(num);
+}
+
+void syscall_stats_dump(void)
+{
+    SyscallStat *sum = syscall_stats_sum.stat;
+    SyscallStatsTable *t;
+    uint64_t calls = 0, time_ns = 0;
+    int i, j, n;
+
+    if (atomic_xchg(&syscall_stats_busy, 1)) {
+        return;
+    }
+    memset(&syscall_stats_sum, 0, sizeof(syscall_stats_sum));
+
+    /* The other threads keep counting meanwhile; a dump is a snapshot
+     * that may be slightly off.
+     */
+    syscall_stats_add(&syscall_stats_sum, &syscall_stats_exited);
+    QLIST_FOREACH(t, &syscall_stats_tables, next) {
+        syscall_stats_add(&syscall_stats_sum, t);
+    }
+
+    for (i = n = 0; i <= SYSCALL_STATS_SLOTS; i++) {
+        if (sum[i].calls) {
+            calls += sum[i].calls;
+            time_ns += sum[i].time_ns;
+            sum[n++] = sum[i];
+        }
+    }
+    /* insertion sort: there are a few dozen entries at most */
+    for (i = 1; i < n; i++) {
+        SyscallStat tmp = sum[i];
+
+        for (j = i; j > 0 && syscall_stat_before(&tmp, &sum[j - 1]); j--) {
+            sum[j] = sum[j - 1];
+        }
+        sum[j] = tmp;
+    }
+
+    if (do_syscall_stats == SYSCALL_STATS_JSON) {
+        syscall_stats_printf("{\"pid\": %d, \"calls\": %" PRIu64
+                             ", \"time_ns\": %" PRIu64 ", \"syscalls\": [",
+                             getpid(), calls, time_ns);
+        for (i = 0; i < n; i++) {
+            const char *name = syscall_stat_name(sum[i].num);
+
+            syscall_stats_printf("%s\n {\"nr\": %d, \"name\": \"%s\", "
+                                 "\"calls\": %" PRIu64 ", "
+                                 "\"time_ns\": %" PRIu64 ", "
+                                 "\"efault\": %" PRIu64 ", "
+                                 "\"eintr\": %" PRIu64 ", "
+                                 "\"restarts\": %" PRIu64 "}",
+                                 i ? "," : "", sum[i].num, name ? name : "",
+                                 sum[i].calls, sum[i].time_ns,
+                                 sum[i].efault, sum[i].eintr, sum[i].restarts);
+        }
+        syscall_stats_printf("]}\n");
+    } else {
+        syscall_stats_printf("%d system calls: %" PRIu64 " calls, %.3f ms\n",
+                             getpid(), calls, time_ns / 1e6);
+        syscall_stats_printf("%-22s %10s %12s %10s %8s %8s %8s\n",
+                             "syscall", "calls", "total ms", "avg us",
+                             "efault", "eintr", "restart");
+        for (i = 0; i < n; i++) {
+            const char *name = syscall_stat_name(sum[i].num);
+            char nr[16];
+
+            if (!name) {
+                snprintf(nr, sizeof(nr), "#%d", sum[i].num);
+                name = nr;
+            }
+            syscall_stats_printf("%-22s %10" PRIu64 " %12.3f %10.3f"
+                                 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+                                 name, sum[i].calls, sum[i].time_ns / 1e6,
+                                 sum[i].time_ns / 1e3 / sum[i].calls,
+                                 sum[i].efault, sum[i].eintr, sum[i].restarts);
+        }
+    }
+    syscall_stats_unlock();
+}
@@ -20,6 +20,7 @@
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
 #include "qemu/path.h"
+#include "qemu/timer.h"
 #include <elf.h>
 #include <endian.h>
 #include <grp.h>
@@ -116,6 +117,7 @@ int __clone2(int (*fn)(void *), void *child_stack_base,
 #include "uname.h"
 
 #include "qemu.h"
+#include "perf.h"
 
 #ifndef CLONE_IO
 #define CLONE_IO                0x80000000      /* Clone io context */
@@ -7818,13 +7820,37 @@ static int host_to_target_cpu_mask(const unsigned long *host_mask,
     return 0;
 }
 
-/* do_syscall() should always have a single exit point at the end so
+/* Work that has to be done before the whole process goes away through
+   exit() or exit_group(): neither of those runs atexit handlers.  */
+void preexit_cleanup(CPUArchState *env, int code)
+{
+#ifdef TARGET_GPROF
+    _mcleanup();
+#endif
+    gdb_exit(env, code);
+    if (qemu_loglevel_mask(CPU_LOG_TB_HOT)) {
+        qemu_log_lock();
+        dump_hot_tbs(qemu_logfile, fprintf, 50);
+        qemu_log_unlock();
+    }
+    if (qemu_loglevel_mask(CPU_LOG_INSN_STATS | CPU_LOG_INSN_EXEC)) {
+        qemu_log_lock();
+        dump_opcount_info(qemu_logfile, fprintf);
+        qemu_log_unlock();
+    }
+    if (do_syscall_stats) {
+        syscall_stats_dump();
+    }
+    perf_exit();
+}
+
+/* do_syscall1() should always have a single exit point at the end so
    that actions, such as logging of syscall results, can be performed.
-   All errnos that do_syscall() returns must be -TARGET_<errcode>. */
-abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
-                    abi_long arg2, abi_long arg3, abi_long arg4,
-                    abi_long arg5, abi_long arg6, abi_long arg7,
-                    abi_long arg8)
+   All errnos that do_syscall1() returns must be -TARGET_<errcode>. */
+static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
+                            abi_long arg2, abi_long arg3, abi_long arg4,
+                            abi_long arg5, abi_long arg6, abi_long arg7,
+                            abi_long arg8)
 {
     CPUState *cpu = ENV_GET_CPU(cpu_env);
     abi_long ret;
@@ -7885,15 +7911,15 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             thread_cpu = NULL;
             object_unref(OBJECT(cpu));
             g_free(ts);
+            if (do_syscall_stats) {
+                syscall_stats_thread_exit();
+            }
             rcu_unregister_thread();
             pthread_exit(NULL);
         }
 
         cpu_list_unlock();
-#ifdef TARGET_GPROF
-        _mcleanup();
-#endif
-        gdb_exit(cpu_env, arg1);
+        preexit_cleanup(cpu_env, arg1);
         _exit(arg1);
         ret = 0; /* avoid warning */
         break;
@@ -9989,10 +10015,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #ifdef __NR_exit_group
         /* new thread calls */
     case TARGET_NR_exit_group:
-#ifdef TARGET_GPROF
-        _mcleanup();
-#endif
-        gdb_exit(cpu_env, arg1);
+        preexit_cleanup(cpu_env, arg1);
         ret = get_errno(exit_group(arg1));
         break;
 #endif
@@ -12591,3 +12614,23 @@ efault:
     ret = -TARGET_EFAULT;
     goto fail;
 }
+
+abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
+                    abi_long arg2, abi_long arg3, abi_long arg4,
+                    abi_long arg5, abi_long arg6, abi_long arg7,
+                    abi_long arg8)
+{
+    int64_t start;
+    abi_long ret;
+
+    if (likely(!do_syscall_stats)) {
+        return do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
+                           arg5, arg6, arg7, arg8);
+    }
+
+    start = get_clock();
+    ret = do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
+                      arg5, arg6, arg7, arg8);
+    syscall_stats_record(num, ret, get_clock() - start);
+    return ret;
+}
@@ -987,6 +987,9 @@ static void qmp_unregister_commands_hack(void)
 #ifndef TARGET_ARM
     qmp_unregister_command(&qmp_commands, "query-gic-capabilities");
 #endif
+#ifndef CONFIG_TCG
+    qmp_unregister_command(&qmp_commands, "x-query-hot-tbs");
+#endif
 #if !defined(TARGET_S390X) && !defined(TARGET_I386)
     qmp_unregister_command(&qmp_commands, "query-cpu-model-expansion");
 #endif
@@ -4172,6 +4175,14 @@ GICCapabilityList *qmp_query_gic_capabilities(Error **errp)
 }
 #endif
 
+#ifndef CONFIG_TCG
+HotTBInfoList *qmp_x_query_hot_tbs(bool has_max, int64_t max, Error **errp)
+{
+    error_setg(errp, QERR_FEATURE_DISABLED, "x-query-hot-tbs");
+    return NULL;
+}
+#endif
+
 HotpluggableCPUList *qmp_query_hotpluggable_cpus(Error **errp)
 {
     MachineState *ms = MACHINE(qdev_get_machine());
@@ -125,9 +125,12 @@ Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
 DEF("accel", HAS_ARG, QEMU_OPTION_accel,
-    "-accel [accel=]accelerator[,thread=single|multi]\n"
+    "-accel [accel=]accelerator[,thread=single|multi][,evict=on|off]\n"
+    "                [,hugepages=on|off]\n"
     "                select accelerator (kvm, xen, hax, hvf or tcg; use 'help' for a list)\n"
-    "                thread=single|multi (enable multi-threaded TCG)", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                evict=on|off (evict TCG translations incrementally)\n"
+    "                hugepages=on|off (back TCG translations with huge pages)", QEMU_ARCH_ALL)
 STEXI
 @item -accel @var{name}[,prop=@var{value}[,...]]
 @findex -accel
@@ -141,6 +144,16 @@ Controls number of TCG threads. When the TCG is multi-threaded there will be one
 thread per vCPU therefor taking advantage of additional host cores. The default
 is to enable multi-threading where both the back-end and front-ends support it and
 no incompatible TCG features have been enabled (e.g. icount/replay).
+@item evict=on|off
+When the translation buffer is full, TCG normally discards all translated
+code.  With @option{evict=on} the buffer is split into regions of about
+2 MB, and only the oldest region that holds little recently executed code
+is discarded.
+@item hugepages=on|off
+Align the translation buffer and its regions to the host's transparent huge
+page size, so that most of the translated code can be backed by huge pages.
+This reduces host TLB misses when running a lot of translated code.
+@code{info jit} reports how much of the buffer is backed by huge pages.
 @end table
 ETEXI
 
@@ -3283,6 +3296,28 @@ STEXI
 Run the emulation in single step mode.
 ETEXI
 
+DEF("perfmap", 0, QEMU_OPTION_perfmap, \
+    "-perfmap        generate a /tmp/perf-${pid}.map file for perf\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -perfmap
+@findex -perfmap
+Generate a map file for Linux perf tools that will allow basic profiling
+information to be broken down into basic blocks.  Each translation block
+is named after its guest PC and, when available, the guest symbol.
+ETEXI
+
+DEF("jitdump", 0, QEMU_OPTION_jitdump, \
+    "-jitdump        generate a jit-${pid}.dump file for perf\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -jitdump
+@findex -jitdump
+Generate a dump file for Linux perf tools that maps basic blocks to symbol
+names and contains a copy of the generated host code.  Use
+@code{perf inject --jit} on the recorded data to annotate translated code.
+ETEXI
+
 DEF("S", 0, QEMU_OPTION_S, \
     "-S              freeze CPU at startup (use 'c' to start execution)\n",
     QEMU_ARCH_ALL)
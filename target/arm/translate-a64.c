@@ -11359,6 +11359,19 @@ static void aarch64_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
         gen_exception(EXCP_UDEF, syn_swstep(dc->ss_same_el, 0, 0),
                       default_exception_el(dc));
         dc->base.is_jmp = DISAS_NORETURN;
+#ifdef CONFIG_USER_ONLY
+    } else if (unlikely(vdso_entry(dc->pc) >= 0)) {
+        /* Replace the "mov x8, #nr; svc #0" at the start of a vDSO
+         * entry point with a direct helper call; the "ret" that
+         * follows is translated normally.
+         */
+        TCGv_i32 tcg_entry = tcg_const_i32(vdso_entry(dc->pc));
+
+        gen_helper_vdso_call(cpu_X[0], cpu_env, tcg_entry,
+                             cpu_X[0], cpu_X[1]);
+        tcg_temp_free_i32(tcg_entry);
+        dc->pc += 8;
+#endif
     } else {
         disas_a64_insn(env, dc);
     }
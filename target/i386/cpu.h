@@ -206,6 +206,11 @@ typedef enum X86Seg {
 #define HF_MPX_EN_MASK       (1 << HF_MPX_EN_SHIFT)
 #define HF_MPX_IU_MASK       (1 << HF_MPX_IU_SHIFT)
 
+/* The TB flags are the hflags ORed with the eflags bits above, plus the
+   CC_OP in effect on entry to the TB in the bits that no hflag uses.  */
+#define TB_FLAGS_CC_OP_SHIFT 27
+#define TB_FLAGS_CC_OP_MASK  (0x1fu << TB_FLAGS_CC_OP_SHIFT)
+
 /* hflags2 */
 
 #define HF2_GIF_SHIFT            0 /* if set CPU takes interrupts */
@@ -1630,13 +1635,45 @@ void tcg_x86_init(void);
 #include "hw/i386/apic.h"
 #endif
 
+/* Only CC_OP_EFLAGS and the arithmetic CC_OPs, after which conditions
+   are most often tested, fit in TB_FLAGS_CC_OP_MASK.  TBs entered with
+   another CC_OP are translated with CC_OP_DYNAMIC, which encodes as 0.  */
+static inline uint32_t x86_tb_flags_from_cc_op(int cc_op)
+{
+    uint32_t v = 0;
+
+    QEMU_BUILD_BUG_ON(CC_OP_DECQ - CC_OP_ADDB + 2
+                      > TB_FLAGS_CC_OP_MASK >> TB_FLAGS_CC_OP_SHIFT);
+    if (cc_op == CC_OP_EFLAGS) {
+        v = 1;
+    } else if (cc_op >= CC_OP_ADDB && cc_op <= CC_OP_DECQ) {
+        v = cc_op - CC_OP_ADDB + 2;
+    }
+    return v << TB_FLAGS_CC_OP_SHIFT;
+}
+
+static inline CCOp x86_tb_flags_to_cc_op(uint32_t flags)
+{
+    uint32_t v = (flags & TB_FLAGS_CC_OP_MASK) >> TB_FLAGS_CC_OP_SHIFT;
+
+    switch (v) {
+    case 0:
+        return CC_OP_DYNAMIC;
+    case 1:
+        return CC_OP_EFLAGS;
+    default:
+        return CC_OP_ADDB + v - 2;
+    }
+}
+
 static inline void cpu_get_tb_cpu_state(CPUX86State *env, target_ulong *pc,
                                         target_ulong *cs_base, uint32_t *flags)
 {
     *cs_base = env->segs[R_CS].base;
     *pc = *cs_base + env->eip;
     *flags = env->hflags |
-        (env->eflags & (IOPL_MASK | TF_MASK | RF_MASK | VM_MASK | AC_MASK));
+        (env->eflags & (IOPL_MASK | TF_MASK | RF_MASK | VM_MASK | AC_MASK)) |
+        x86_tb_flags_from_cc_op(env->cc_op);
 }
 
 void do_cpu_init(X86CPU *cpu);
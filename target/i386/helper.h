@@ -78,6 +78,9 @@ DEF_HELPER_2(cmpxchg8b, void, env, tl)
 DEF_HELPER_2(cmpxchg16b_unlocked, void, env, tl)
 DEF_HELPER_2(cmpxchg16b, void, env, tl)
 #endif
+DEF_HELPER_3(rep_movs, void, env, i32, i32)
+DEF_HELPER_3(rep_stos, void, env, i32, i32)
+DEF_HELPER_4(rep_cmps, void, env, i32, i32, i32)
 DEF_HELPER_1(single_step, void, env)
 DEF_HELPER_1(rechecking_single_step, void, env)
 DEF_HELPER_1(cpuid, void, env)
@@ -128,16 +131,21 @@ DEF_HELPER_1(fisttl_ST0, s32, env)
 DEF_HELPER_1(fisttll_ST0, s64, env)
 DEF_HELPER_2(fldt_ST0, void, env, tl)
 DEF_HELPER_2(fstt_ST0, void, env, tl)
-DEF_HELPER_1(fpush, void, env)
-DEF_HELPER_1(fpop, void, env)
-DEF_HELPER_1(fdecstp, void, env)
-DEF_HELPER_1(fincstp, void, env)
-DEF_HELPER_2(ffree_STN, void, env, int)
-DEF_HELPER_1(fmov_ST0_FT0, void, env)
-DEF_HELPER_2(fmov_FT0_STN, void, env, int)
-DEF_HELPER_2(fmov_ST0_STN, void, env, int)
-DEF_HELPER_2(fmov_STN_ST0, void, env, int)
-DEF_HELPER_2(fxchg_ST0_STN, void, env, int)
+DEF_HELPER_FLAGS_1(fpush, TCG_CALL_NO_RWG | TCG_CALL_INLINE, void, env)
+DEF_HELPER_FLAGS_1(fpop, TCG_CALL_NO_RWG | TCG_CALL_INLINE, void, env)
+DEF_HELPER_FLAGS_1(fdecstp, TCG_CALL_NO_RWG | TCG_CALL_INLINE, void, env)
+DEF_HELPER_FLAGS_1(fincstp, TCG_CALL_NO_RWG | TCG_CALL_INLINE, void, env)
+DEF_HELPER_FLAGS_2(ffree_STN, TCG_CALL_NO_RWG | TCG_CALL_INLINE,
+                   void, env, int)
+DEF_HELPER_FLAGS_1(fmov_ST0_FT0, TCG_CALL_NO_RWG | TCG_CALL_INLINE, void, env)
+DEF_HELPER_FLAGS_2(fmov_FT0_STN, TCG_CALL_NO_RWG | TCG_CALL_INLINE,
+                   void, env, int)
+DEF_HELPER_FLAGS_2(fmov_ST0_STN, TCG_CALL_NO_RWG | TCG_CALL_INLINE,
+                   void, env, int)
+DEF_HELPER_FLAGS_2(fmov_STN_ST0, TCG_CALL_NO_RWG | TCG_CALL_INLINE,
+                   void, env, int)
+DEF_HELPER_FLAGS_2(fxchg_ST0_STN, TCG_CALL_NO_RWG | TCG_CALL_INLINE,
+                   void, env, int)
 DEF_HELPER_1(fcom_ST0_FT0, void, env)
 DEF_HELPER_1(fucom_ST0_FT0, void, env)
 DEF_HELPER_1(fcomi_ST0_FT0, void, env)
@@ -208,7 +216,7 @@ DEF_HELPER_FLAGS_2(pext, TCG_CALL_NO_RWG_SE, tl, tl, tl)
 
 DEF_HELPER_2(ldmxcsr, void, env, i32)
 DEF_HELPER_1(enter_mmx, void, env)
-DEF_HELPER_1(emms, void, env)
+DEF_HELPER_FLAGS_1(emms, TCG_CALL_NO_RWG | TCG_CALL_INLINE, void, env)
 DEF_HELPER_3(movq, void, env, ptr, ptr)
 
 #define SHIFT 0
@@ -138,7 +138,7 @@ void helper_cmpxchg16b(CPUX86State *env, target_ulong a0)
     if ((a0 & 0xf) != 0) {
         raise_exception_ra(env, EXCP0D_GPF, ra);
     } else {
-#ifndef CONFIG_ATOMIC128
+#if !HAVE_CMPXCHG128
         cpu_loop_exit_atomic(ENV_GET_CPU(env), ra);
 #else
         int eflags = cpu_cc_compute_all(env, CC_OP);
@@ -193,6 +193,249 @@ void helper_boundl(CPUX86State *env, target_ulong a0, int v)
     }
 }
 
+/* Bulk rep movs/stos/cmps, for strings whose addresses need no segment
+   base.  Each call handles as many elements as fit in one page on every
+   side, on host memory when the pages are plain RAM, and otherwise a
+   single element through the usual accessors.  The registers are then
+   updated as after that many iterations, so that the translated loop
+   can take faults and interrupts between calls with a precise state.  */
+
+static target_ulong rep_addr_mask(int aflag)
+{
+#ifdef TARGET_X86_64
+    if (aflag == MO_64) {
+        return -1;
+    }
+#endif
+    return 0xffffffff;
+}
+
+/* The number of elements, at most N, which can be accessed from ADDR
+   in the direction DF without leaving the page.  */
+static target_ulong rep_chunk(target_ulong addr, int shift, int df,
+                              target_ulong n)
+{
+    target_ulong ofs = addr & ~TARGET_PAGE_MASK;
+    target_ulong room;
+
+    if (ofs + (1 << shift) > TARGET_PAGE_SIZE) {
+        return 0;
+    }
+    room = df > 0 ? TARGET_PAGE_SIZE - ofs : ofs + (1 << shift);
+    return MIN(n, room >> shift);
+}
+
+static void *rep_probe(CPUX86State *env, target_ulong addr, target_ulong len,
+                       MMUAccessType access_type)
+{
+#ifdef CONFIG_USER_ONLY
+    if (!h2g_valid(g2h(addr))
+        || page_check_range(addr, len, access_type == MMU_DATA_STORE
+                            ? PAGE_WRITE : PAGE_READ) < 0) {
+        return NULL;
+    }
+    return g2h(addr);
+#else
+    return tlb_vaddr_to_host(env, addr, access_type, cpu_mmu_index(env, false));
+#endif
+}
+
+static uint64_t rep_ld_host(void *p, int shift)
+{
+    switch (shift) {
+    case MO_8:
+        return ldub_p(p);
+    case MO_16:
+        return lduw_le_p(p);
+    case MO_32:
+        return ldl_le_p(p);
+    default:
+        return ldq_le_p(p);
+    }
+}
+
+static void rep_st_host(void *p, int shift, uint64_t val)
+{
+    switch (shift) {
+    case MO_8:
+        stb_p(p, val);
+        break;
+    case MO_16:
+        stw_le_p(p, val);
+        break;
+    case MO_32:
+        stl_le_p(p, val);
+        break;
+    default:
+        stq_le_p(p, val);
+        break;
+    }
+}
+
+static uint64_t rep_ld(CPUX86State *env, target_ulong addr, int shift,
+                       uintptr_t ra)
+{
+    switch (shift) {
+    case MO_8:
+        return cpu_ldub_data_ra(env, addr, ra);
+    case MO_16:
+        return cpu_lduw_data_ra(env, addr, ra);
+    case MO_32:
+        return cpu_ldl_data_ra(env, addr, ra);
+    default:
+        return cpu_ldq_data_ra(env, addr, ra);
+    }
+}
+
+static void rep_st(CPUX86State *env, target_ulong addr, int shift,
+                   uint64_t val, uintptr_t ra)
+{
+    switch (shift) {
+    case MO_8:
+        cpu_stb_data_ra(env, addr, val, ra);
+        break;
+    case MO_16:
+        cpu_stw_data_ra(env, addr, val, ra);
+        break;
+    case MO_32:
+        cpu_stl_data_ra(env, addr, val, ra);
+        break;
+    default:
+        cpu_stq_data_ra(env, addr, val, ra);
+        break;
+    }
+}
+
+/* Advance the string register REG, and decrement ECX, by N elements.  */
+static void rep_advance(CPUX86State *env, int reg, target_ulong n, int shift,
+                        target_ulong mask)
+{
+    env->regs[reg] = (env->regs[reg] + env->df * (target_long)(n << shift))
+                     & mask;
+}
+
+void helper_rep_movs(CPUX86State *env, uint32_t shift, uint32_t aflag)
+{
+    target_ulong mask = rep_addr_mask(aflag);
+    target_ulong count = env->regs[R_ECX] & mask;
+    target_ulong src = env->regs[R_ESI] & mask;
+    target_ulong dst = env->regs[R_EDI] & mask;
+    target_ulong n, len, i;
+    uint8_t *hs, *hd;
+    int size = 1 << shift;
+
+    n = rep_chunk(src, shift, env->df, rep_chunk(dst, shift, env->df, count));
+    len = n << shift;
+    hs = hd = NULL;
+    if (n) {
+        hs = rep_probe(env, env->df > 0 ? src : src - len + size, len,
+                       MMU_DATA_LOAD);
+        hd = hs ? rep_probe(env, env->df > 0 ? dst : dst - len + size, len,
+                            MMU_DATA_STORE) : NULL;
+    }
+    if (!hd) {
+        n = 1;
+        rep_st(env, dst, shift, rep_ld(env, src, shift, GETPC()), GETPC());
+    } else if (env->df > 0 ? hd <= hs || hd >= hs + len
+                           : hd >= hs || hd + len <= hs) {
+        /* Copying element by element in the direction of DF reads no
+           element that it has already written.  */
+        memmove(hd, hs, len);
+    } else if (env->df > 0) {
+        for (i = 0; i < len; i += size) {
+            rep_st_host(hd + i, shift, rep_ld_host(hs + i, shift));
+        }
+    } else {
+        for (i = len - size; i < len; i -= size) {
+            rep_st_host(hd + i, shift, rep_ld_host(hs + i, shift));
+        }
+    }
+    rep_advance(env, R_ESI, n, shift, mask);
+    rep_advance(env, R_EDI, n, shift, mask);
+    env->regs[R_ECX] = (count - n) & mask;
+}
+
+void helper_rep_stos(CPUX86State *env, uint32_t shift, uint32_t aflag)
+{
+    target_ulong mask = rep_addr_mask(aflag);
+    target_ulong count = env->regs[R_ECX] & mask;
+    target_ulong dst = env->regs[R_EDI] & mask;
+    uint64_t val = env->regs[R_EAX];
+    target_ulong n, len, i;
+    uint8_t *hd = NULL;
+    int size = 1 << shift;
+
+    n = rep_chunk(dst, shift, env->df, count);
+    len = n << shift;
+    if (n) {
+        hd = rep_probe(env, env->df > 0 ? dst : dst - len + size, len,
+                       MMU_DATA_STORE);
+    }
+    if (!hd) {
+        n = 1;
+        rep_st(env, dst, shift, val, GETPC());
+    } else if (shift == MO_8) {
+        memset(hd, val, len);
+    } else {
+        for (i = 0; i < len; i += size) {
+            rep_st_host(hd + i, shift, val);
+        }
+    }
+    rep_advance(env, R_EDI, n, shift, mask);
+    env->regs[R_ECX] = (count - n) & mask;
+}
+
+/* Compare elements until one pair is (NZ set) or is not (NZ clear) equal,
+   leaving CC_SRC and CC_DST as the translator does for the last CMPS.  */
+void helper_rep_cmps(CPUX86State *env, uint32_t shift, uint32_t aflag,
+                     uint32_t nz)
+{
+    target_ulong mask = rep_addr_mask(aflag);
+    target_ulong count = env->regs[R_ECX] & mask;
+    target_ulong src = env->regs[R_ESI] & mask;
+    target_ulong dst = env->regs[R_EDI] & mask;
+    target_ulong n, len, i;
+    uint64_t v1, v2;
+    uint8_t *hs, *hd;
+    int size = 1 << shift;
+
+    n = rep_chunk(src, shift, env->df, rep_chunk(dst, shift, env->df, count));
+    len = n << shift;
+    hs = hd = NULL;
+    if (n) {
+        hs = rep_probe(env, env->df > 0 ? src : src - len + size, len,
+                       MMU_DATA_LOAD);
+        hd = hs ? rep_probe(env, env->df > 0 ? dst : dst - len + size, len,
+                            MMU_DATA_LOAD) : NULL;
+    }
+    if (!hd) {
+        n = 1;
+        v2 = rep_ld(env, dst, shift, GETPC());
+        v1 = rep_ld(env, src, shift, GETPC());
+    } else {
+        /* Point at the first element in string order.  */
+        if (env->df < 0) {
+            hs += len - size;
+            hd += len - size;
+        }
+        for (i = 1; ; i++) {
+            v1 = rep_ld_host(hs, shift);
+            v2 = rep_ld_host(hd, shift);
+            if (i == n || (v1 == v2) == nz) {
+                break;
+            }
+            hs += env->df * size;
+            hd += env->df * size;
+        }
+        n = i;
+    }
+    env->cc_src = v2;
+    env->cc_dst = v1 - v2;
+    rep_advance(env, R_ESI, n, shift, mask);
+    rep_advance(env, R_EDI, n, shift, mask);
+    env->regs[R_ECX] = (count - n) & mask;
+}
+
 #if !defined(CONFIG_USER_ONLY)
 /* try to fill the TLB and return an exception if error. If retaddr is
  * NULL, it means that the function was called in C code (i.e. not
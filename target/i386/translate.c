@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg-op.h"
+#include "tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -1033,7 +1034,8 @@ static inline void gen_jcc1_noeob(DisasContext *s, int b, TCGLabel *l1)
 
 /* Generate a conditional jump to label 'l1' according to jump opcode
    value 'b'. In the fast case, T0 is guaranted not to be used.
-   A translation block must end soon.  */
+   A translation block must end soon.  CC_OP is synced, and stays known
+   on both paths so that the block exits can be chained.  */
 static inline void gen_jcc1(DisasContext *s, int b, TCGLabel *l1)
 {
     CCPrepare cc = gen_prepare_cc(s, b, cpu_T0);
@@ -1043,7 +1045,6 @@ static inline void gen_jcc1(DisasContext *s, int b, TCGLabel *l1)
         tcg_gen_andi_tl(cpu_T0, cc.reg, cc.mask);
         cc.reg = cpu_T0;
     }
-    set_cc_op(s, CC_OP_DYNAMIC);
     if (cc.use_reg2) {
         tcg_gen_brcond_tl(cc.cond, cc.reg, cc.reg2, l1);
     } else {
@@ -1053,14 +1054,19 @@ static inline void gen_jcc1(DisasContext *s, int b, TCGLabel *l1)
 
 /* XXX: does not work with gdbstub "ice" single step - not a
    serious problem */
+/* The caller must have synced CC_OP, and must make it CC_OP_DYNAMIC
+   if it jumps to the returned label with another CC_OP.  */
 static TCGLabel *gen_jz_ecx_string(DisasContext *s, target_ulong next_eip)
 {
     TCGLabel *l1 = gen_new_label();
     TCGLabel *l2 = gen_new_label();
+    CCOp cc_op = s->cc_op;
+
     gen_op_jnz_ecx(s->aflag, l1);
     gen_set_label(l2);
     gen_jmp_tb(s, next_eip, 1);
     gen_set_label(l1);
+    s->cc_op = cc_op;
     return l2;
 }
 
@@ -1183,6 +1189,7 @@ static inline void gen_repz_ ## op(DisasContext *s, TCGMemOp ot,              \
 {                                                                             \
     TCGLabel *l2;                                                             \
     gen_update_cc_op(s);                                                      \
+    set_cc_op(s, CC_OP_DYNAMIC);                                              \
     l2 = gen_jz_ecx_string(s, next_eip);                                      \
     gen_ ## op(s, ot);                                                        \
     gen_op_add_reg_im(s->aflag, R_ECX, -1);                                   \
@@ -1201,6 +1208,86 @@ GEN_REPZ(outs)
 GEN_REPZ2(scas)
 GEN_REPZ2(cmps)
 
+/* When the string addresses need no segment base, the rep movs, stos
+   and cmps loops hand whole page-bounded chunks to a helper each time
+   around, instead of doing a single element.  Single-stepping (TF or
+   the gdbstub) must still trap after every element.  */
+static inline bool use_rep_bulk(DisasContext *s)
+{
+    return s->jmp_opt && s->aflag != MO_16 && s->override < 0 && !s->addseg;
+}
+
+static void gen_repz_bulk(DisasContext *s, TCGMemOp ot,
+                          target_ulong cur_eip, target_ulong next_eip,
+                          void (*gen_bulk)(TCGv_ptr, TCGv_i32, TCGv_i32))
+{
+    TCGLabel *l2;
+    TCGv_i32 t_ot, t_aflag;
+
+    gen_update_cc_op(s);
+    l2 = gen_jz_ecx_string(s, next_eip);
+    t_ot = tcg_const_i32(ot);
+    t_aflag = tcg_const_i32(s->aflag);
+    gen_bulk(cpu_env, t_ot, t_aflag);
+    tcg_temp_free_i32(t_ot);
+    tcg_temp_free_i32(t_aflag);
+    if (s->repz_opt) {
+        gen_op_jz_ecx(s->aflag, l2);
+    }
+    gen_jmp(s, cur_eip);
+}
+
+static void gen_repz_movs_bulk(DisasContext *s, TCGMemOp ot,
+                               target_ulong cur_eip, target_ulong next_eip)
+{
+    if (use_rep_bulk(s)) {
+        gen_repz_bulk(s, ot, cur_eip, next_eip, gen_helper_rep_movs);
+    } else {
+        gen_repz_movs(s, ot, cur_eip, next_eip);
+    }
+}
+
+static void gen_repz_stos_bulk(DisasContext *s, TCGMemOp ot,
+                               target_ulong cur_eip, target_ulong next_eip)
+{
+    if (use_rep_bulk(s)) {
+        gen_repz_bulk(s, ot, cur_eip, next_eip, gen_helper_rep_stos);
+    } else {
+        gen_repz_stos(s, ot, cur_eip, next_eip);
+    }
+}
+
+static void gen_repz_cmps_bulk(DisasContext *s, TCGMemOp ot,
+                               target_ulong cur_eip, target_ulong next_eip,
+                               int nz)
+{
+    TCGLabel *l2;
+    TCGv_i32 t_ot, t_aflag, t_nz;
+
+    if (!use_rep_bulk(s)) {
+        gen_repz_cmps(s, ot, cur_eip, next_eip, nz);
+        return;
+    }
+    gen_update_cc_op(s);
+    set_cc_op(s, CC_OP_DYNAMIC);
+    l2 = gen_jz_ecx_string(s, next_eip);
+    t_ot = tcg_const_i32(ot);
+    t_aflag = tcg_const_i32(s->aflag);
+    t_nz = tcg_const_i32(nz);
+    gen_helper_rep_cmps(cpu_env, t_ot, t_aflag, t_nz);
+    tcg_temp_free_i32(t_ot);
+    tcg_temp_free_i32(t_aflag);
+    tcg_temp_free_i32(t_nz);
+    tcg_gen_add_tl(cpu_cc_srcT, cpu_cc_dst, cpu_cc_src);
+    set_cc_op(s, CC_OP_SUBB + ot);
+    gen_update_cc_op(s);
+    gen_jcc1(s, (JCC_Z << 1) | (nz ^ 1), l2);
+    if (s->repz_opt) {
+        gen_op_jz_ecx(s->aflag, l2);
+    }
+    gen_jmp(s, cur_eip);
+}
+
 static void gen_helper_fp_arith_ST0_FT0(int op)
 {
     switch (op) {
@@ -2185,11 +2272,13 @@ static inline bool use_goto_tb(DisasContext *s, target_ulong pc)
 #endif
 }
 
+/* The next TB is specialized on the CC_OP it is entered with, so only
+   chain to it when this exit always leaves the same, synced, CC_OP.  */
 static inline void gen_goto_tb(DisasContext *s, int tb_num, target_ulong eip)
 {
     target_ulong pc = s->cs_base + eip;
 
-    if (use_goto_tb(s, pc))  {
+    if (use_goto_tb(s, pc) && s->cc_op != CC_OP_DYNAMIC) {
         /* jump to same page: we can use a direct jump */
         tcg_gen_goto_tb(tb_num);
         gen_jmp_im(eip);
@@ -2608,18 +2697,43 @@ static void gen_jr(DisasContext *s, TCGv dest)
     do_gen_eob_worker(s, false, false, true);
 }
 
+/* Return to DEST, using the prediction pushed by gen_call_ras.  This is
+   possible when the end of block needs no flag updates nor debug traps,
+   so that the cs_base and flags after the return are those of this TB,
+   and when the CC_OP that the flags also encode is known.  */
+static void gen_ret_jr(DisasContext *s, TCGv dest)
+{
+    if (s->base.singlestep_enabled || s->tf || s->cc_op == CC_OP_DYNAMIC
+        || (s->flags & (HF_INHIBIT_IRQ_MASK | HF_RF_MASK | HF_MPX_EN_MASK))) {
+        gen_jr(s, dest);
+        return;
+    }
+    gen_update_cc_op(s);
+    tcg_gen_addi_tl(dest, dest, s->cs_base);
+    tcg_gen_ras_lookup_and_goto_ptr(dest, s->cs_base,
+                                    (s->flags & ~TB_FLAGS_CC_OP_MASK)
+                                    | x86_tb_flags_from_cc_op(s->cc_op));
+    s->base.is_jmp = DISAS_NORETURN;
+}
+
+/* Predict that the call being translated returns to NEXT_EIP.  */
+static void gen_call_ras(DisasContext *s, target_ulong next_eip)
+{
+    tcg_gen_ras_push(next_eip + s->cs_base);
+}
+
 /* generate a jump to eip. No segment change must happen before as a
    direct call to the next block may occur */
 static void gen_jmp_tb(DisasContext *s, target_ulong eip, int tb_num)
 {
     gen_update_cc_op(s);
-    set_cc_op(s, CC_OP_DYNAMIC);
     if (s->jmp_opt) {
         gen_goto_tb(s, tb_num, eip);
     } else {
         gen_jmp_im(eip);
         gen_eob(s);
     }
+    set_cc_op(s, CC_OP_DYNAMIC);
 }
 
 static void gen_jmp(DisasContext *s, target_ulong eip)
@@ -3018,7 +3132,7 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start, int rex_r)
 {
-    int b1, op1_offset, op2_offset, is_xmm, val;
+    int b1, op1_offset, op2_offset, is_xmm, val, vec_len;
     int modrm, mod, rm, reg;
     SSEFunc_0_epp sse_fn_epp;
     SSEFunc_0_eppi sse_fn_eppi;
@@ -4392,7 +4506,52 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 op2_offset = offsetof(CPUX86State,fpregs[rm].mmx);
             }
         }
+        /* Integer and bitwise operations that act on the whole register
+           are expanded inline rather than through a helper.  */
+        vec_len = is_xmm ? 16 : 8;
         switch(b) {
+        case 0x54: /* andps, andpd */
+        case 0xdb: /* pand */
+            tcg_gen_gvec_and(MO_64, op1_offset, op1_offset, op2_offset,
+                             vec_len, vec_len);
+            break;
+        case 0x55: /* andnps, andnpd */
+        case 0xdf: /* pandn */
+            tcg_gen_gvec_andc(MO_64, op1_offset, op2_offset, op1_offset,
+                              vec_len, vec_len);
+            break;
+        case 0x56: /* orps, orpd */
+        case 0xeb: /* por */
+            tcg_gen_gvec_or(MO_64, op1_offset, op1_offset, op2_offset,
+                            vec_len, vec_len);
+            break;
+        case 0x57: /* xorps, xorpd */
+        case 0xef: /* pxor */
+            if (op1_offset == op2_offset) {
+                /* The common idiom for clearing a register.  */
+                tcg_gen_gvec_dup64i(op1_offset, vec_len, vec_len, 0);
+            } else {
+                tcg_gen_gvec_xor(MO_64, op1_offset, op1_offset, op2_offset,
+                                 vec_len, vec_len);
+            }
+            break;
+        case 0xfc: /* paddb */
+        case 0xfd: /* paddw */
+        case 0xfe: /* paddd */
+            tcg_gen_gvec_add(b - 0xfc, op1_offset, op1_offset, op2_offset,
+                             vec_len, vec_len);
+            break;
+        case 0xd4: /* paddq */
+            tcg_gen_gvec_add(MO_64, op1_offset, op1_offset, op2_offset,
+                             vec_len, vec_len);
+            break;
+        case 0xf8: /* psubb */
+        case 0xf9: /* psubw */
+        case 0xfa: /* psubd */
+        case 0xfb: /* psubq */
+            tcg_gen_gvec_sub(b - 0xf8, op1_offset, op1_offset, op2_offset,
+                             vec_len, vec_len);
+            break;
         case 0x0f: /* 3DNow! data insns */
             val = x86_ldub_code(env, s);
             sse_fn_epp = sse_op_table5[val];
@@ -4622,6 +4781,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
 
     /* now check op code */
  reswitch:
+    s->base.insn_class = b;
     switch(b) {
     case 0x0f:
         /**************************/
@@ -5030,6 +5190,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             next_eip = s->pc - s->cs_base;
             tcg_gen_movi_tl(cpu_T1, next_eip);
             gen_push_v(s, cpu_T1);
+            gen_call_ras(s, next_eip);
             gen_op_jmp_v(cpu_T0);
             gen_bnd_jmp(s);
             gen_jr(s, cpu_T0);
@@ -6282,7 +6443,8 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
     case 0xa5:
         ot = mo_b_d(b, dflag);
         if (prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) {
-            gen_repz_movs(s, ot, pc_start - s->cs_base, s->pc - s->cs_base);
+            gen_repz_movs_bulk(s, ot, pc_start - s->cs_base,
+                               s->pc - s->cs_base);
         } else {
             gen_movs(s, ot);
         }
@@ -6292,7 +6454,8 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
     case 0xab:
         ot = mo_b_d(b, dflag);
         if (prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) {
-            gen_repz_stos(s, ot, pc_start - s->cs_base, s->pc - s->cs_base);
+            gen_repz_stos_bulk(s, ot, pc_start - s->cs_base,
+                               s->pc - s->cs_base);
         } else {
             gen_stos(s, ot);
         }
@@ -6322,9 +6485,11 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
     case 0xa7:
         ot = mo_b_d(b, dflag);
         if (prefixes & PREFIX_REPNZ) {
-            gen_repz_cmps(s, ot, pc_start - s->cs_base, s->pc - s->cs_base, 1);
+            gen_repz_cmps_bulk(s, ot, pc_start - s->cs_base,
+                               s->pc - s->cs_base, 1);
         } else if (prefixes & PREFIX_REPZ) {
-            gen_repz_cmps(s, ot, pc_start - s->cs_base, s->pc - s->cs_base, 0);
+            gen_repz_cmps_bulk(s, ot, pc_start - s->cs_base,
+                               s->pc - s->cs_base, 0);
         } else {
             gen_cmps(s, ot);
         }
@@ -6451,7 +6616,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         /* Note that gen_pop_T0 uses a zero-extending load.  */
         gen_op_jmp_v(cpu_T0);
         gen_bnd_jmp(s);
-        gen_jr(s, cpu_T0);
+        gen_ret_jr(s, cpu_T0);
         break;
     case 0xc3: /* ret */
         ot = gen_pop_T0(s);
@@ -6459,7 +6624,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         /* Note that gen_pop_T0 uses a zero-extending load.  */
         gen_op_jmp_v(cpu_T0);
         gen_bnd_jmp(s);
-        gen_jr(s, cpu_T0);
+        gen_ret_jr(s, cpu_T0);
         break;
     case 0xca: /* lret im */
         val = x86_ldsw_code(env, s);
@@ -6524,6 +6689,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             }
             tcg_gen_movi_tl(cpu_T0, next_eip);
             gen_push_v(s, cpu_T0);
+            gen_call_ras(s, next_eip);
             gen_bnd_jmp(s);
             gen_jmp(s, tval);
         }
@@ -8319,6 +8485,185 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
     return s->pc;
 }
 
+/* Inline expansions of the x87 helpers that merely move registers and
+   tags around the FPU stack; see tcg_register_helper_expansion.  */
+
+/* Return ENV + (((fpstt + ST) & 7) << SHIFT), ST being NULL for ST0. */
+static TCGv_ptr gen_fpstt_ptr(TCGv_ptr env, TCGv_i32 st, int shift)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+    TCGv_ptr p = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(t, env, offsetof(CPUX86State, fpstt));
+    if (st) {
+        tcg_gen_add_i32(t, t, st);
+    }
+    tcg_gen_andi_i32(t, t, 7);
+    tcg_gen_shli_i32(t, t, shift);
+    tcg_gen_ext_i32_ptr(p, t);
+    tcg_gen_add_ptr(p, p, env);
+    tcg_temp_free_i32(t);
+    return p;
+}
+
+static TCGv_ptr gen_fpreg_ptr(TCGv_ptr env, TCGv_i32 st)
+{
+    QEMU_BUILD_BUG_ON(sizeof(FPReg) != 16);
+    return gen_fpstt_ptr(env, st, 4);
+}
+
+static void gen_fmov(TCGv_ptr dst, size_t dofs, TCGv_ptr src, size_t sofs)
+{
+    TCGv_i64 lo = tcg_temp_new_i64();
+    TCGv_i32 hi = tcg_temp_new_i32();
+
+    tcg_gen_ld_i64(lo, src, sofs + offsetof(floatx80, low));
+    tcg_gen_ld16u_i32(hi, src, sofs + offsetof(floatx80, high));
+    tcg_gen_st_i64(lo, dst, dofs + offsetof(floatx80, low));
+    tcg_gen_st16_i32(hi, dst, dofs + offsetof(floatx80, high));
+    tcg_temp_free_i64(lo);
+    tcg_temp_free_i32(hi);
+}
+
+static void gen_fpstt_add(TCGv_ptr env, int delta, bool clear_fpus)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(t, env, offsetof(CPUX86State, fpstt));
+    tcg_gen_addi_i32(t, t, delta);
+    tcg_gen_andi_i32(t, t, 7);
+    tcg_gen_st_i32(t, env, offsetof(CPUX86State, fpstt));
+    if (clear_fpus) {
+        tcg_gen_ld16u_i32(t, env, offsetof(CPUX86State, fpus));
+        tcg_gen_andi_i32(t, t, ~0x4700);
+        tcg_gen_st16_i32(t, env, offsetof(CPUX86State, fpus));
+    }
+    tcg_temp_free_i32(t);
+}
+
+static void gen_fptag_set(TCGv_ptr env, TCGv_i32 st, int tag)
+{
+    TCGv_ptr p = gen_fpstt_ptr(env, st, 0);
+    TCGv_i32 t = tcg_const_i32(tag);
+
+    tcg_gen_st8_i32(t, p, offsetof(CPUX86State, fptags));
+    tcg_temp_free_i32(t);
+    tcg_temp_free_ptr(p);
+}
+
+static void gen_expand_fpush(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+
+    gen_fpstt_add(env, -1, false);
+    gen_fptag_set(env, NULL, 0);
+}
+
+static void gen_expand_fpop(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+
+    gen_fptag_set(env, NULL, 1);
+    gen_fpstt_add(env, 1, false);
+}
+
+static void gen_expand_fdecstp(TCGTemp *ret, TCGTemp **args)
+{
+    gen_fpstt_add(temp_tcgv_ptr(args[0]), -1, true);
+}
+
+static void gen_expand_fincstp(TCGTemp *ret, TCGTemp **args)
+{
+    gen_fpstt_add(temp_tcgv_ptr(args[0]), 1, true);
+}
+
+static void gen_expand_ffree_STN(TCGTemp *ret, TCGTemp **args)
+{
+    gen_fptag_set(temp_tcgv_ptr(args[0]), temp_tcgv_i32(args[1]), 1);
+}
+
+static void gen_expand_fmov_ST0_FT0(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+    TCGv_ptr st0 = gen_fpreg_ptr(env, NULL);
+
+    gen_fmov(st0, offsetof(CPUX86State, fpregs[0].d),
+             env, offsetof(CPUX86State, ft0));
+    tcg_temp_free_ptr(st0);
+}
+
+static void gen_expand_fmov_FT0_STN(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+    TCGv_ptr stn = gen_fpreg_ptr(env, temp_tcgv_i32(args[1]));
+
+    gen_fmov(env, offsetof(CPUX86State, ft0),
+             stn, offsetof(CPUX86State, fpregs[0].d));
+    tcg_temp_free_ptr(stn);
+}
+
+static void gen_expand_fmov_ST0_STN(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+    TCGv_ptr st0 = gen_fpreg_ptr(env, NULL);
+    TCGv_ptr stn = gen_fpreg_ptr(env, temp_tcgv_i32(args[1]));
+
+    gen_fmov(st0, offsetof(CPUX86State, fpregs[0].d),
+             stn, offsetof(CPUX86State, fpregs[0].d));
+    tcg_temp_free_ptr(st0);
+    tcg_temp_free_ptr(stn);
+}
+
+static void gen_expand_fmov_STN_ST0(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+    TCGv_ptr st0 = gen_fpreg_ptr(env, NULL);
+    TCGv_ptr stn = gen_fpreg_ptr(env, temp_tcgv_i32(args[1]));
+
+    gen_fmov(stn, offsetof(CPUX86State, fpregs[0].d),
+             st0, offsetof(CPUX86State, fpregs[0].d));
+    tcg_temp_free_ptr(st0);
+    tcg_temp_free_ptr(stn);
+}
+
+static void gen_expand_fxchg_ST0_STN(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+    TCGv_ptr st0 = gen_fpreg_ptr(env, NULL);
+    TCGv_ptr stn = gen_fpreg_ptr(env, temp_tcgv_i32(args[1]));
+    size_t ofs = offsetof(CPUX86State, fpregs[0].d);
+    TCGv_i64 lo0 = tcg_temp_new_i64();
+    TCGv_i64 lon = tcg_temp_new_i64();
+    TCGv_i32 hi0 = tcg_temp_new_i32();
+    TCGv_i32 hin = tcg_temp_new_i32();
+
+    tcg_gen_ld_i64(lo0, st0, ofs + offsetof(floatx80, low));
+    tcg_gen_ld16u_i32(hi0, st0, ofs + offsetof(floatx80, high));
+    tcg_gen_ld_i64(lon, stn, ofs + offsetof(floatx80, low));
+    tcg_gen_ld16u_i32(hin, stn, ofs + offsetof(floatx80, high));
+    tcg_gen_st_i64(lo0, stn, ofs + offsetof(floatx80, low));
+    tcg_gen_st16_i32(hi0, stn, ofs + offsetof(floatx80, high));
+    tcg_gen_st_i64(lon, st0, ofs + offsetof(floatx80, low));
+    tcg_gen_st16_i32(hin, st0, ofs + offsetof(floatx80, high));
+    tcg_temp_free_i64(lo0);
+    tcg_temp_free_i64(lon);
+    tcg_temp_free_i32(hi0);
+    tcg_temp_free_i32(hin);
+    tcg_temp_free_ptr(st0);
+    tcg_temp_free_ptr(stn);
+}
+
+static void gen_expand_emms(TCGTemp *ret, TCGTemp **args)
+{
+    TCGv_ptr env = temp_tcgv_ptr(args[0]);
+    TCGv_i32 t = tcg_const_i32(0x01010101);
+
+    /* set to empty state */
+    tcg_gen_st_i32(t, env, offsetof(CPUX86State, fptags));
+    tcg_gen_st_i32(t, env, offsetof(CPUX86State, fptags) + 4);
+    tcg_temp_free_i32(t);
+}
+
 void tcg_x86_init(void)
 {
     static const char reg_names[CPU_NB_REGS][4] = {
@@ -8364,6 +8709,7 @@ void tcg_x86_init(void)
     static const char bnd_regu_names[4][8] = {
         "bnd0_ub", "bnd1_ub", "bnd2_ub", "bnd3_ub"
     };
+    static const char *insn_class_names[0x200];
     int i;
 
     cpu_cc_op = tcg_global_mem_new_i32(cpu_env,
@@ -8398,6 +8744,31 @@ void tcg_x86_init(void)
                                      offsetof(CPUX86State, bnd_regs[i].ub),
                                      bnd_regu_names[i]);
     }
+
+    tcg_register_helper_expansion(helper_fpush, gen_expand_fpush);
+    tcg_register_helper_expansion(helper_fpop, gen_expand_fpop);
+    tcg_register_helper_expansion(helper_fdecstp, gen_expand_fdecstp);
+    tcg_register_helper_expansion(helper_fincstp, gen_expand_fincstp);
+    tcg_register_helper_expansion(helper_ffree_STN, gen_expand_ffree_STN);
+    tcg_register_helper_expansion(helper_fmov_ST0_FT0,
+                                  gen_expand_fmov_ST0_FT0);
+    tcg_register_helper_expansion(helper_fmov_FT0_STN,
+                                  gen_expand_fmov_FT0_STN);
+    tcg_register_helper_expansion(helper_fmov_ST0_STN,
+                                  gen_expand_fmov_ST0_STN);
+    tcg_register_helper_expansion(helper_fmov_STN_ST0,
+                                  gen_expand_fmov_STN_ST0);
+    tcg_register_helper_expansion(helper_fxchg_ST0_STN,
+                                  gen_expand_fxchg_ST0_STN);
+    tcg_register_helper_expansion(helper_emms, gen_expand_emms);
+
+    /* Instruction classes are the opcode, 0x100 and up for 0x0f xx.  */
+    for (i = 0; i < ARRAY_SIZE(insn_class_names); ++i) {
+        insn_class_names[i] = g_strdup_printf(i < 0x100 ? "%02x" : "0f %02x",
+                                              i & 0xff);
+    }
+    translator_register_insn_classes(insn_class_names,
+                                     ARRAY_SIZE(insn_class_names));
 }
 
 static int i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu,
@@ -8417,7 +8788,7 @@ static int i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu,
     dc->cpl = (flags >> HF_CPL_SHIFT) & 3;
     dc->iopl = (flags >> IOPL_SHIFT) & 3;
     dc->tf = (flags >> TF_SHIFT) & 1;
-    dc->cc_op = CC_OP_DYNAMIC;
+    dc->cc_op = x86_tb_flags_to_cc_op(flags);
     dc->cc_op_dirty = false;
     dc->cs_base = cs_base;
     dc->popl_esp_hack = 0;
@@ -8474,6 +8845,13 @@ static int i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu,
 
 static void i386_tr_tb_start(DisasContextBase *db, CPUState *cpu)
 {
+    DisasContext *dc = container_of(db, DisasContext, base);
+
+    /* CC_SRCT does not live across TBs; recover it from the operands
+       of the subtraction that set the CC_OP this TB was entered with.  */
+    if (cc_op_live[dc->cc_op] & USES_CC_SRCT) {
+        tcg_gen_add_tl(cpu_cc_srcT, cpu_cc_dst, cpu_cc_src);
+    }
 }
 
 static void i386_tr_insn_start(DisasContextBase *dcbase, CPUState *cpu)
@@ -8503,10 +8881,45 @@ static bool i386_tr_breakpoint_check(DisasContextBase *dcbase, CPUState *cpu,
     }
 }
 
+#if defined(CONFIG_USER_ONLY) && defined(TARGET_X86_64)
+/* Length of "mov $nr, %eax; syscall" at the start of each vDSO entry.  */
+#define VDSO_SYSCALL_LEN 7
+
+/* Translate the system call of a vDSO entry point as a direct helper
+   call.  The "ret" that follows is translated normally.  */
+static bool gen_vdso_call(DisasContext *s)
+{
+    int entry;
+    TCGv_i32 t_entry;
+
+    if (!CODE64(s)) {
+        return false;
+    }
+    entry = vdso_entry(s->base.pc_next);
+    if (entry < 0) {
+        return false;
+    }
+    t_entry = tcg_const_i32(entry);
+    gen_helper_vdso_call(cpu_regs[R_EAX], cpu_env, t_entry,
+                         cpu_regs[R_EDI], cpu_regs[R_ESI]);
+    tcg_temp_free_i32(t_entry);
+    return true;
+}
+#endif
+
 static void i386_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *dc = container_of(dcbase, DisasContext, base);
-    target_ulong pc_next = disas_insn(dc, cpu);
+    target_ulong pc_next;
+
+#if defined(CONFIG_USER_ONLY) && defined(TARGET_X86_64)
+    if (unlikely(gen_vdso_call(dc))) {
+        pc_next = dc->base.pc_next + VDSO_SYSCALL_LEN;
+    } else
+#endif
+    {
+        pc_next = disas_insn(dc, cpu);
+    }
 
     if (dc->tf || (dc->base.tb->flags & HF_INHIBIT_IRQ_MASK)) {
         /* if single step mode, we generate only one instruction and
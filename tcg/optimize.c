@@ -599,6 +599,242 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/* Loads and stores that translators issue directly on cpu_env.  Within
+   a basic block, remember which temp holds the contents of an env field,
+   so that a later load of the same field becomes a move, and which
+   stores have not been read yet, so that a store to the same field
+   can drop them.  */
+#define ENV_MEM_SLOTS  16
+
+typedef struct EnvMemVal {
+    intptr_t ofs;
+    TCGOpcode ld_opc;
+    int size;
+    TCGTemp *val;
+} EnvMemVal;
+
+typedef struct EnvMemStore {
+    intptr_t ofs;
+    int size;
+    TCGOp *op;
+} EnvMemStore;
+
+typedef struct EnvMemInfo {
+    TCGTemp *env;
+    int nb_vals;
+    int nb_stores;
+    EnvMemVal vals[ENV_MEM_SLOTS];
+    EnvMemStore stores[ENV_MEM_SLOTS];
+} EnvMemInfo;
+
+/* Return the access size of a host load or store, or 0.  For a store,
+   *LD_OPC is the load that reads back exactly the stored value, or
+   NB_OPS if there is none.  */
+static int env_mem_access(TCGOpcode opc, bool *is_store, TCGOpcode *ld_opc)
+{
+    *is_store = false;
+    *ld_opc = opc;
+
+    switch (opc) {
+    case INDEX_op_ld8u_i32:
+    case INDEX_op_ld8s_i32:
+    case INDEX_op_ld8u_i64:
+    case INDEX_op_ld8s_i64:
+        return 1;
+    case INDEX_op_ld16u_i32:
+    case INDEX_op_ld16s_i32:
+    case INDEX_op_ld16u_i64:
+    case INDEX_op_ld16s_i64:
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+        return 8;
+    default:
+        break;
+    }
+
+    *is_store = true;
+    *ld_opc = NB_OPS;
+
+    switch (opc) {
+    case INDEX_op_st8_i32:
+    case INDEX_op_st8_i64:
+        return 1;
+    case INDEX_op_st16_i32:
+    case INDEX_op_st16_i64:
+        return 2;
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_st_i32:
+        *ld_opc = INDEX_op_ld_i32;
+        return 4;
+    case INDEX_op_st_i64:
+        *ld_opc = INDEX_op_ld_i64;
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static inline bool env_mem_overlap(intptr_t ofs1, int size1,
+                                   intptr_t ofs2, int size2)
+{
+    return ofs1 < ofs2 + size2 && ofs2 < ofs1 + size1;
+}
+
+static void env_mem_kill_vals(EnvMemInfo *em, intptr_t ofs, int size)
+{
+    int i, j;
+
+    for (i = j = 0; i < em->nb_vals; i++) {
+        if (!env_mem_overlap(em->vals[i].ofs, em->vals[i].size, ofs, size)) {
+            em->vals[j++] = em->vals[i];
+        }
+    }
+    em->nb_vals = j;
+}
+
+static void env_mem_kill_temp(EnvMemInfo *em, TCGTemp *ts)
+{
+    int i, j;
+
+    for (i = j = 0; i < em->nb_vals; i++) {
+        if (em->vals[i].val != ts) {
+            em->vals[j++] = em->vals[i];
+        }
+    }
+    em->nb_vals = j;
+}
+
+/* Drop the pending stores that overlap [OFS, OFS + SIZE).  If OP is
+   not NULL, it overwrites them, so remove them from the op stream.  */
+static void env_mem_kill_stores(TCGContext *s, EnvMemInfo *em,
+                                intptr_t ofs, int size, TCGOp *op)
+{
+    int i, j;
+
+    for (i = j = 0; i < em->nb_stores; i++) {
+        EnvMemStore *st = &em->stores[i];
+
+        if (!env_mem_overlap(st->ofs, st->size, ofs, size)) {
+            em->stores[j++] = *st;
+        } else if (op && ofs <= st->ofs && st->ofs + st->size <= ofs + size) {
+            tcg_op_remove(s, st->op);
+        }
+    }
+    em->nb_stores = j;
+}
+
+static void env_mem_add_val(EnvMemInfo *em, intptr_t ofs, int size,
+                            TCGOpcode ld_opc, TCGTemp *val)
+{
+    if (em->nb_vals == ENV_MEM_SLOTS) {
+        memmove(&em->vals[0], &em->vals[1],
+                sizeof(EnvMemVal) * (ENV_MEM_SLOTS - 1));
+        em->nb_vals--;
+    }
+    em->vals[em->nb_vals++] = (EnvMemVal){ ofs, ld_opc, size, val };
+}
+
+static void env_mem_add_store(EnvMemInfo *em, intptr_t ofs, int size,
+                              TCGOp *op)
+{
+    if (em->nb_stores == ENV_MEM_SLOTS) {
+        memmove(&em->stores[0], &em->stores[1],
+                sizeof(EnvMemStore) * (ENV_MEM_SLOTS - 1));
+        em->nb_stores--;
+    }
+    em->stores[em->nb_stores++] = (EnvMemStore){ ofs, size, op };
+}
+
+/* Track the env memory effects of OP, which may be turned into a move
+   if it reloads a field whose value is already in a temp.  Return false
+   if OP was a redundant store and has been removed.  */
+static bool env_mem_op(TCGContext *s, EnvMemInfo *em, TCGOp *op)
+{
+    TCGOpcode opc = op->opc;
+    const TCGOpDef *def = &tcg_op_defs[opc];
+    TCGOpcode ld_opc;
+    bool is_store;
+    int i, size;
+
+    size = env_mem_access(opc, &is_store, &ld_opc);
+    if (size && arg_temp(op->args[1]) == em->env) {
+        intptr_t ofs = op->args[2];
+
+        if (is_store) {
+            for (i = 0; i < em->nb_vals; i++) {
+                EnvMemVal *v = &em->vals[i];
+
+                if (v->ofs == ofs && v->ld_opc == ld_opc
+                    && v->val == arg_temp(op->args[0])) {
+                    /* The field already holds this value.  */
+                    tcg_op_remove(s, op);
+                    return false;
+                }
+            }
+            env_mem_kill_stores(s, em, ofs, size, op);
+            env_mem_kill_vals(em, ofs, size);
+            if (ld_opc != NB_OPS) {
+                env_mem_add_val(em, ofs, size, ld_opc,
+                                arg_temp(op->args[0]));
+            }
+            env_mem_add_store(em, ofs, size, op);
+            return true;
+        }
+
+        env_mem_kill_stores(s, em, ofs, size, NULL);
+        for (i = 0; i < em->nb_vals; i++) {
+            EnvMemVal *v = &em->vals[i];
+
+            if (v->ofs == ofs && v->ld_opc == opc) {
+                TCGTemp *val = v->val;
+
+                op->opc = op_to_mov(opc);
+                op->args[1] = temp_arg(val);
+                if (arg_temp(op->args[0]) != val) {
+                    env_mem_kill_temp(em, arg_temp(op->args[0]));
+                }
+                return true;
+            }
+        }
+        env_mem_kill_temp(em, arg_temp(op->args[0]));
+        env_mem_add_val(em, ofs, size, opc, arg_temp(op->args[0]));
+        return true;
+    }
+
+    if (opc == INDEX_op_call || (def->flags & TCG_OPF_BB_END)) {
+        /* Helpers may access env through any pointer.  */
+        em->nb_vals = 0;
+        em->nb_stores = 0;
+        return true;
+    }
+    if (opc == INDEX_op_ld_vec || opc == INDEX_op_st_vec) {
+        is_store = opc == INDEX_op_st_vec;
+        size = 1;
+    }
+    if (size) {
+        /* Through a pointer other than env, which may still point
+           into env.  */
+        if (is_store) {
+            em->nb_vals = 0;
+        } else {
+            em->nb_stores = 0;
+        }
+    }
+    if (def->flags & TCG_OPF_SIDE_EFFECTS) {
+        /* The op may raise an exception, which must see every store.  */
+        em->nb_stores = 0;
+    }
+    for (i = 0; i < def->nb_oargs; i++) {
+        env_mem_kill_temp(em, arg_temp(op->args[i]));
+    }
+    return true;
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -606,6 +842,7 @@ void tcg_optimize(TCGContext *s)
     TCGOp *op, *op_next, *prev_mb = NULL;
     struct tcg_temp_info *infos;
     TCGTempSet temps_used;
+    EnvMemInfo env_mem;
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
@@ -616,13 +853,22 @@ void tcg_optimize(TCGContext *s)
     nb_globals = s->nb_globals;
     bitmap_zero(temps_used.l, nb_temps);
     infos = tcg_malloc(sizeof(struct tcg_temp_info) * nb_temps);
+    env_mem.env = tcgv_ptr_temp(cpu_env);
+    env_mem.nb_vals = 0;
+    env_mem.nb_stores = 0;
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
         tcg_target_ulong mask, partmask, affected;
         int nb_oargs, nb_iargs, i;
         TCGArg tmp;
-        TCGOpcode opc = op->opc;
-        const TCGOpDef *def = &tcg_op_defs[opc];
+        TCGOpcode opc;
+        const TCGOpDef *def;
+
+        if (!env_mem_op(s, &env_mem, op)) {
+            continue;
+        }
+        opc = op->opc;
+        def = &tcg_op_defs[opc];
 
         /* Count the arguments, and initialize the temps that are
            going to be used */
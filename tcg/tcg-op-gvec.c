@@ -0,0 +1,631 @@
+/*
+ * Generic vector operation expansion
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "tcg.h"
+#include "tcg-op.h"
+#include "tcg-op-gvec.h"
+
+/* Expansion of an operation with one vector input.  */
+typedef struct {
+    /* Expand inline as a 64-bit operation.  */
+    void (*fni8)(TCGv_i64, TCGv_i64);
+    /* Expand inline with a host vector type.  */
+    void (*fniv)(unsigned, TCGv_vec, TCGv_vec);
+    /* The vector opcode required by FNIV, or 0 if none.  */
+    TCGOpcode opc;
+    /* The element size passed to FNIV.  */
+    uint8_t vece;
+    /* Prefer i64 to v64.  */
+    bool prefer_i64;
+} GVecGen2;
+
+/* Expansion of an operation with two vector inputs.  */
+typedef struct {
+    void (*fni8)(TCGv_i64, TCGv_i64, TCGv_i64);
+    void (*fniv)(unsigned, TCGv_vec, TCGv_vec, TCGv_vec);
+    TCGOpcode opc;
+    uint8_t vece;
+    bool prefer_i64;
+} GVecGen3;
+
+static void check_size_align(uint32_t oprsz, uint32_t maxsz)
+{
+    tcg_debug_assert(oprsz <= maxsz);
+    tcg_debug_assert(oprsz % 8 == 0);
+    tcg_debug_assert(maxsz % 8 == 0);
+}
+
+/* Return true if the host vector types may be used to expand OPC.  */
+static bool vec_op_ok(TCGOpcode opc)
+{
+    return TCG_TARGET_MAYBE_vec && (opc == 0 || tcg_op_supported(opc));
+}
+
+/* Clear MAXSZ - OPRSZ bytes at DOFS + OPRSZ.  */
+static void expand_clr(uint32_t dofs, uint32_t oprsz, uint32_t maxsz)
+{
+    TCGv_i64 zero;
+    uint32_t i;
+
+    if (oprsz == maxsz) {
+        return;
+    }
+    zero = tcg_const_i64(0);
+    for (i = oprsz; i < maxsz; i += 8) {
+        tcg_gen_st_i64(zero, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(zero);
+}
+
+/* Expand OPSZ bytes worth of two-operand operations using i64 elements,
+   starting at byte offset OFS.  */
+static void expand_2_i64(uint32_t dofs, uint32_t aofs, uint32_t ofs,
+                         uint32_t oprsz, void (*fni)(TCGv_i64, TCGv_i64))
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+
+    for (; ofs < oprsz; ofs += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + ofs);
+        fni(t0, t0);
+        tcg_gen_st_i64(t0, cpu_env, dofs + ofs);
+    }
+    tcg_temp_free_i64(t0);
+}
+
+/* Expand as many TYSZ-byte chunks as fit below OPRSZ using host vector
+   type TYPE.  Return the offset of the first byte not processed.  */
+static uint32_t expand_2_vec(unsigned vece, uint32_t dofs, uint32_t aofs,
+                             uint32_t ofs, uint32_t oprsz, uint32_t tysz,
+                             TCGType type,
+                             void (*fni)(unsigned, TCGv_vec, TCGv_vec))
+{
+    TCGv_vec t0;
+
+    if (ofs + tysz > oprsz) {
+        return ofs;
+    }
+    t0 = tcg_temp_new_vec(type);
+    for (; ofs + tysz <= oprsz; ofs += tysz) {
+        tcg_gen_ld_vec(t0, cpu_env, aofs + ofs);
+        fni(vece, t0, t0);
+        tcg_gen_st_vec(t0, cpu_env, dofs + ofs);
+    }
+    tcg_temp_free_vec(t0);
+    return ofs;
+}
+
+static void expand_3_i64(uint32_t dofs, uint32_t aofs, uint32_t bofs,
+                         uint32_t ofs, uint32_t oprsz,
+                         void (*fni)(TCGv_i64, TCGv_i64, TCGv_i64))
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+
+    for (; ofs < oprsz; ofs += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + ofs);
+        tcg_gen_ld_i64(t1, cpu_env, bofs + ofs);
+        fni(t2, t0, t1);
+        tcg_gen_st_i64(t2, cpu_env, dofs + ofs);
+    }
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+}
+
+static uint32_t expand_3_vec(unsigned vece, uint32_t dofs, uint32_t aofs,
+                             uint32_t bofs, uint32_t ofs, uint32_t oprsz,
+                             uint32_t tysz, TCGType type,
+                             void (*fni)(unsigned, TCGv_vec,
+                                         TCGv_vec, TCGv_vec))
+{
+    TCGv_vec t0, t1, t2;
+
+    if (ofs + tysz > oprsz) {
+        return ofs;
+    }
+    t0 = tcg_temp_new_vec(type);
+    t1 = tcg_temp_new_vec(type);
+    t2 = tcg_temp_new_vec(type);
+    for (; ofs + tysz <= oprsz; ofs += tysz) {
+        tcg_gen_ld_vec(t0, cpu_env, aofs + ofs);
+        tcg_gen_ld_vec(t1, cpu_env, bofs + ofs);
+        fni(vece, t2, t0, t1);
+        tcg_gen_st_vec(t2, cpu_env, dofs + ofs);
+    }
+    tcg_temp_free_vec(t2);
+    tcg_temp_free_vec(t1);
+    tcg_temp_free_vec(t0);
+    return ofs;
+}
+
+/* Expand a vector two-operand operation.  Operands may be identical,
+   but must not otherwise overlap.  */
+static void tcg_gen_gvec_2(uint32_t dofs, uint32_t aofs,
+                           uint32_t oprsz, uint32_t maxsz, const GVecGen2 *g)
+{
+    uint32_t ofs = 0;
+
+    check_size_align(oprsz, maxsz);
+    if (g->fniv && vec_op_ok(g->opc)) {
+        if (TCG_TARGET_HAS_v256) {
+            ofs = expand_2_vec(g->vece, dofs, aofs, ofs, oprsz,
+                               32, TCG_TYPE_V256, g->fniv);
+        }
+        if (TCG_TARGET_HAS_v128) {
+            ofs = expand_2_vec(g->vece, dofs, aofs, ofs, oprsz,
+                               16, TCG_TYPE_V128, g->fniv);
+        }
+        if (TCG_TARGET_HAS_v64 && !g->prefer_i64) {
+            ofs = expand_2_vec(g->vece, dofs, aofs, ofs, oprsz,
+                               8, TCG_TYPE_V64, g->fniv);
+        }
+    }
+    expand_2_i64(dofs, aofs, ofs, oprsz, g->fni8);
+    expand_clr(dofs, oprsz, maxsz);
+}
+
+/* Expand a vector three-operand operation.  */
+static void tcg_gen_gvec_3(uint32_t dofs, uint32_t aofs, uint32_t bofs,
+                           uint32_t oprsz, uint32_t maxsz, const GVecGen3 *g)
+{
+    uint32_t ofs = 0;
+
+    check_size_align(oprsz, maxsz);
+    if (g->fniv && vec_op_ok(g->opc)) {
+        if (TCG_TARGET_HAS_v256) {
+            ofs = expand_3_vec(g->vece, dofs, aofs, bofs, ofs, oprsz,
+                               32, TCG_TYPE_V256, g->fniv);
+        }
+        if (TCG_TARGET_HAS_v128) {
+            ofs = expand_3_vec(g->vece, dofs, aofs, bofs, ofs, oprsz,
+                               16, TCG_TYPE_V128, g->fniv);
+        }
+        if (TCG_TARGET_HAS_v64 && !g->prefer_i64) {
+            ofs = expand_3_vec(g->vece, dofs, aofs, bofs, ofs, oprsz,
+                               8, TCG_TYPE_V64, g->fniv);
+        }
+    }
+    expand_3_i64(dofs, aofs, bofs, ofs, oprsz, g->fni8);
+    expand_clr(dofs, oprsz, maxsz);
+}
+
+/*
+ * Expand specific vector operations.
+ */
+
+static void vec_mov2(unsigned vece, TCGv_vec a, TCGv_vec b)
+{
+    tcg_gen_mov_vec(a, b);
+}
+
+void tcg_gen_gvec_mov(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen2 g = {
+        .fni8 = tcg_gen_mov_i64,
+        .fniv = vec_mov2,
+        .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+    };
+    if (dofs != aofs) {
+        tcg_gen_gvec_2(dofs, aofs, oprsz, maxsz, &g);
+    } else {
+        check_size_align(oprsz, maxsz);
+        expand_clr(dofs, oprsz, maxsz);
+    }
+}
+
+void tcg_gen_gvec_not(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen2 g = {
+        .fni8 = tcg_gen_not_i64,
+        .fniv = tcg_gen_not_vec,
+        .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+    };
+    tcg_gen_gvec_2(dofs, aofs, oprsz, maxsz, &g);
+}
+
+/* Perform a vector addition using normal addition and a mask.  The mask
+   should be the sign bit of each lane.  This 6-operation form is more
+   efficient than separate additions when there are 4 or more lanes in
+   the 64-bit operation.  */
+static void gen_addv_mask(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b, TCGv_i64 m)
+{
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+    TCGv_i64 t3 = tcg_temp_new_i64();
+
+    tcg_gen_andc_i64(t1, a, m);
+    tcg_gen_andc_i64(t2, b, m);
+    tcg_gen_xor_i64(t3, a, b);
+    tcg_gen_add_i64(d, t1, t2);
+    tcg_gen_and_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+}
+
+void tcg_gen_vec_add8_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 m = tcg_const_i64(dup_const(MO_8, 0x80));
+    gen_addv_mask(d, a, b, m);
+    tcg_temp_free_i64(m);
+}
+
+void tcg_gen_vec_add16_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 m = tcg_const_i64(dup_const(MO_16, 0x8000));
+    gen_addv_mask(d, a, b, m);
+    tcg_temp_free_i64(m);
+}
+
+void tcg_gen_vec_add32_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+
+    tcg_gen_andi_i64(t1, a, ~0xffffffffull);
+    tcg_gen_add_i64(t2, a, b);
+    tcg_gen_add_i64(t1, t1, b);
+    tcg_gen_deposit_i64(d, t1, t2, 0, 32);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+}
+
+void tcg_gen_gvec_add(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g[4] = {
+        { .fni8 = tcg_gen_vec_add8_i64,
+          .fniv = tcg_gen_add_vec,
+          .opc = INDEX_op_add_vec,
+          .vece = MO_8 },
+        { .fni8 = tcg_gen_vec_add16_i64,
+          .fniv = tcg_gen_add_vec,
+          .opc = INDEX_op_add_vec,
+          .vece = MO_16 },
+        { .fni8 = tcg_gen_vec_add32_i64,
+          .fniv = tcg_gen_add_vec,
+          .opc = INDEX_op_add_vec,
+          .vece = MO_32 },
+        { .fni8 = tcg_gen_add_i64,
+          .fniv = tcg_gen_add_vec,
+          .opc = INDEX_op_add_vec,
+          .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+          .vece = MO_64 },
+    };
+
+    tcg_debug_assert(vece <= MO_64);
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g[vece]);
+}
+
+/* Perform a vector subtraction using normal subtraction and a mask.
+   Compare gen_addv_mask above.  */
+static void gen_subv_mask(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b, TCGv_i64 m)
+{
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+    TCGv_i64 t3 = tcg_temp_new_i64();
+
+    tcg_gen_or_i64(t1, a, m);
+    tcg_gen_andc_i64(t2, b, m);
+    tcg_gen_eqv_i64(t3, a, b);
+    tcg_gen_sub_i64(d, t1, t2);
+    tcg_gen_and_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+}
+
+void tcg_gen_vec_sub8_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 m = tcg_const_i64(dup_const(MO_8, 0x80));
+    gen_subv_mask(d, a, b, m);
+    tcg_temp_free_i64(m);
+}
+
+void tcg_gen_vec_sub16_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 m = tcg_const_i64(dup_const(MO_16, 0x8000));
+    gen_subv_mask(d, a, b, m);
+    tcg_temp_free_i64(m);
+}
+
+void tcg_gen_vec_sub32_i64(TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+
+    tcg_gen_andi_i64(t1, b, ~0xffffffffull);
+    tcg_gen_sub_i64(t2, a, b);
+    tcg_gen_sub_i64(t1, a, t1);
+    tcg_gen_deposit_i64(d, t1, t2, 0, 32);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+}
+
+void tcg_gen_gvec_sub(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g[4] = {
+        { .fni8 = tcg_gen_vec_sub8_i64,
+          .fniv = tcg_gen_sub_vec,
+          .opc = INDEX_op_sub_vec,
+          .vece = MO_8 },
+        { .fni8 = tcg_gen_vec_sub16_i64,
+          .fniv = tcg_gen_sub_vec,
+          .opc = INDEX_op_sub_vec,
+          .vece = MO_16 },
+        { .fni8 = tcg_gen_vec_sub32_i64,
+          .fniv = tcg_gen_sub_vec,
+          .opc = INDEX_op_sub_vec,
+          .vece = MO_32 },
+        { .fni8 = tcg_gen_sub_i64,
+          .fniv = tcg_gen_sub_vec,
+          .opc = INDEX_op_sub_vec,
+          .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+          .vece = MO_64 },
+    };
+
+    tcg_debug_assert(vece <= MO_64);
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g[vece]);
+}
+
+static void gen_vec_neg8_i64(TCGv_i64 d, TCGv_i64 b)
+{
+    TCGv_i64 z = tcg_const_i64(0);
+    tcg_gen_vec_sub8_i64(d, z, b);
+    tcg_temp_free_i64(z);
+}
+
+static void gen_vec_neg16_i64(TCGv_i64 d, TCGv_i64 b)
+{
+    TCGv_i64 z = tcg_const_i64(0);
+    tcg_gen_vec_sub16_i64(d, z, b);
+    tcg_temp_free_i64(z);
+}
+
+static void gen_vec_neg32_i64(TCGv_i64 d, TCGv_i64 b)
+{
+    TCGv_i64 z = tcg_const_i64(0);
+    tcg_gen_vec_sub32_i64(d, z, b);
+    tcg_temp_free_i64(z);
+}
+
+void tcg_gen_gvec_neg(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen2 g[4] = {
+        { .fni8 = gen_vec_neg8_i64,
+          .fniv = tcg_gen_neg_vec,
+          .vece = MO_8 },
+        { .fni8 = gen_vec_neg16_i64,
+          .fniv = tcg_gen_neg_vec,
+          .vece = MO_16 },
+        { .fni8 = gen_vec_neg32_i64,
+          .fniv = tcg_gen_neg_vec,
+          .vece = MO_32 },
+        { .fni8 = tcg_gen_neg_i64,
+          .fniv = tcg_gen_neg_vec,
+          .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+          .vece = MO_64 },
+    };
+
+    tcg_debug_assert(vece <= MO_64);
+    tcg_gen_gvec_2(dofs, aofs, oprsz, maxsz, &g[vece]);
+}
+
+void tcg_gen_gvec_and(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = tcg_gen_and_i64,
+        .fniv = tcg_gen_and_vec,
+        .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+    };
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_or(unsigned vece, uint32_t dofs, uint32_t aofs,
+                     uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = tcg_gen_or_i64,
+        .fniv = tcg_gen_or_vec,
+        .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+    };
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_xor(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = tcg_gen_xor_i64,
+        .fniv = tcg_gen_xor_vec,
+        .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+    };
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+void tcg_gen_gvec_andc(unsigned vece, uint32_t dofs, uint32_t aofs,
+                       uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    static const GVecGen3 g = {
+        .fni8 = tcg_gen_andc_i64,
+        .fniv = tcg_gen_andc_vec,
+        .prefer_i64 = TCG_TARGET_REG_BITS == 64,
+    };
+    tcg_gen_gvec_3(dofs, aofs, bofs, oprsz, maxsz, &g);
+}
+
+/*
+ * Replicate a scalar across the vector.
+ */
+
+/* Store IN64, already replicated across 64 bits, to OPRSZ bytes
+   at DOFS and clear the rest of the vector.  */
+static void do_dup_store(TCGv_i64 in64, uint32_t dofs,
+                         uint32_t oprsz, uint32_t maxsz)
+{
+    uint32_t i;
+
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_st_i64(in64, cpu_env, dofs + i);
+    }
+    expand_clr(dofs, oprsz, maxsz);
+}
+
+static uint32_t do_dup_store_vec(TCGv_vec t, uint32_t dofs, uint32_t ofs,
+                                 uint32_t oprsz, uint32_t tysz)
+{
+    for (; ofs + tysz <= oprsz; ofs += tysz) {
+        tcg_gen_st_vec(t, cpu_env, dofs + ofs);
+    }
+    return ofs;
+}
+
+/* Return the largest host vector type that fits within OPRSZ, or
+   TCG_TYPE_COUNT if none is available.  */
+static TCGType choose_dup_type(uint32_t oprsz)
+{
+    if (!TCG_TARGET_MAYBE_vec) {
+        return TCG_TYPE_COUNT;
+    }
+    if (TCG_TARGET_HAS_v256 && oprsz >= 32) {
+        return TCG_TYPE_V256;
+    }
+    if (TCG_TARGET_HAS_v128 && oprsz >= 16) {
+        return TCG_TYPE_V128;
+    }
+    return TCG_TYPE_COUNT;
+}
+
+/* Expand a duplication whose 64-bit replicated value is in IN64, and
+   whose element, when host vectors are used, is either IN32 or IN64
+   of size VECE, or the constant CVAL if neither is given.  */
+static void do_dup(unsigned vece, uint32_t dofs, uint32_t oprsz,
+                   uint32_t maxsz, TCGv_i32 in32, TCGv_i64 in64,
+                   uint64_t cval)
+{
+    TCGType type = choose_dup_type(oprsz);
+    TCGv_i64 t64;
+    uint32_t ofs = 0;
+
+    check_size_align(oprsz, maxsz);
+
+    if (type != TCG_TYPE_COUNT) {
+        TCGv_vec t = tcg_temp_new_vec(type);
+
+        if (in32) {
+            tcg_gen_dup_i32_vec(vece, t, in32);
+        } else if (in64) {
+            tcg_gen_dup_i64_vec(vece, t, in64);
+        } else {
+            tcg_gen_dup64i_vec(t, dup_const(vece, cval));
+        }
+        if (type == TCG_TYPE_V256) {
+            ofs = do_dup_store_vec(t, dofs, ofs, oprsz, 32);
+            if (ofs < oprsz) {
+                /* Finish the tail with a 128-bit store.  */
+                tcg_temp_free_vec(t);
+                t = tcg_temp_new_vec(TCG_TYPE_V128);
+                if (in32) {
+                    tcg_gen_dup_i32_vec(vece, t, in32);
+                } else if (in64) {
+                    tcg_gen_dup_i64_vec(vece, t, in64);
+                } else {
+                    tcg_gen_dup64i_vec(t, dup_const(vece, cval));
+                }
+            }
+        }
+        ofs = do_dup_store_vec(t, dofs, ofs, oprsz, 16);
+        tcg_temp_free_vec(t);
+        if (ofs == oprsz) {
+            expand_clr(dofs, oprsz, maxsz);
+            return;
+        }
+    }
+
+    /* Replicate the element across 64 bits for the remainder.  */
+    t64 = tcg_temp_new_i64();
+    if (in32) {
+        tcg_gen_extu_i32_i64(t64, in32);
+    } else if (in64) {
+        tcg_gen_mov_i64(t64, in64);
+    } else {
+        tcg_gen_movi_i64(t64, dup_const(vece, cval));
+    }
+    if (in32 || in64) {
+        switch (vece) {
+        case MO_8:
+            tcg_gen_ext8u_i64(t64, t64);
+            tcg_gen_muli_i64(t64, t64, dup_const(MO_8, 1));
+            break;
+        case MO_16:
+            tcg_gen_ext16u_i64(t64, t64);
+            tcg_gen_muli_i64(t64, t64, dup_const(MO_16, 1));
+            break;
+        case MO_32:
+            tcg_gen_deposit_i64(t64, t64, t64, 32, 32);
+            break;
+        default:
+            break;
+        }
+    }
+    do_dup_store(t64, dofs + ofs, oprsz - ofs, maxsz - ofs);
+    tcg_temp_free_i64(t64);
+}
+
+void tcg_gen_gvec_dup_i32(unsigned vece, uint32_t dofs, uint32_t oprsz,
+                          uint32_t maxsz, TCGv_i32 in)
+{
+    tcg_debug_assert(vece <= MO_32);
+    do_dup(vece, dofs, oprsz, maxsz, in, NULL, 0);
+}
+
+void tcg_gen_gvec_dup_i64(unsigned vece, uint32_t dofs, uint32_t oprsz,
+                          uint32_t maxsz, TCGv_i64 in)
+{
+    tcg_debug_assert(vece <= MO_64);
+    do_dup(vece, dofs, oprsz, maxsz, NULL, in, 0);
+}
+
+void tcg_gen_gvec_dup8i(uint32_t dofs, uint32_t oprsz,
+                        uint32_t maxsz, uint8_t x)
+{
+    do_dup(MO_8, dofs, oprsz, maxsz, NULL, NULL, x);
+}
+
+void tcg_gen_gvec_dup16i(uint32_t dofs, uint32_t oprsz,
+                         uint32_t maxsz, uint16_t x)
+{
+    do_dup(MO_16, dofs, oprsz, maxsz, NULL, NULL, x);
+}
+
+void tcg_gen_gvec_dup32i(uint32_t dofs, uint32_t oprsz,
+                         uint32_t maxsz, uint32_t x)
+{
+    do_dup(MO_32, dofs, oprsz, maxsz, NULL, NULL, x);
+}
+
+void tcg_gen_gvec_dup64i(uint32_t dofs, uint32_t oprsz,
+                         uint32_t maxsz, uint64_t x)
+{
+    do_dup(MO_64, dofs, oprsz, maxsz, NULL, NULL, x);
+}
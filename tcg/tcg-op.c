@@ -26,6 +26,7 @@
 #include "qemu-common.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "exec/tb-hash.h"
 #include "tcg.h"
 #include "tcg-op.h"
 #include "tcg-mo.h"
@@ -2546,6 +2547,95 @@ void tcg_gen_lookup_and_goto_ptr(void)
     }
 }
 
+/* Entries are addressed by byte offset, wrapping with a mask.  */
+QEMU_BUILD_BUG_ON(sizeof(CPURASEntry) & (sizeof(CPURASEntry) - 1));
+
+void tcg_gen_ras_push(target_ulong ret_pc)
+{
+    TCGv_i32 top = tcg_temp_new_i32();
+    TCGv_i32 ofs = tcg_const_i32(-ENV_OFFSET + offsetof(CPUState, tb_jmp_cache)
+                                 + tb_jmp_cache_hash_func(ret_pc)
+                                 * sizeof(TranslationBlock *));
+    TCGv pc = tcg_const_tl(ret_pc);
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+
+    tcg_gen_ld_i32(top, cpu_env, offsetof(CPUArchState, ras_top));
+    tcg_gen_addi_i32(top, top, sizeof(CPURASEntry));
+    tcg_gen_andi_i32(top, top, sizeof(CPURASEntry) * CPU_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, cpu_env, offsetof(CPUArchState, ras_top));
+    tcg_gen_ext_i32_ptr(ptr, top);
+    tcg_gen_add_ptr(ptr, ptr, cpu_env);
+    tcg_gen_st_tl(pc, ptr, offsetof(CPUArchState, ras[0].pc));
+    tcg_gen_st_i32(ofs, ptr, offsetof(CPUArchState, ras[0].jmp_cache_ofs));
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free(pc);
+    tcg_temp_free_i32(ofs);
+    tcg_temp_free_i32(top);
+}
+
+void tcg_gen_ras_lookup_and_goto_ptr(TCGv pc, target_ulong cs_base,
+                                     uint32_t flags)
+{
+    TCGLabel *miss;
+    TCGv lpc, t;
+    TCGv_i32 t32;
+    TCGv_ptr ptr, tb;
+
+    if (!TCG_TARGET_HAS_goto_ptr || qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    miss = gen_new_label();
+    lpc = tcg_temp_local_new();
+    t = tcg_temp_new();
+    t32 = tcg_temp_new_i32();
+    ptr = tcg_temp_new_ptr();
+    tb = tcg_temp_local_new_ptr();
+
+    /* Pop the top entry, and check that it predicted PC.  */
+    tcg_gen_mov_tl(lpc, pc);
+    tcg_gen_ld_i32(t32, cpu_env, offsetof(CPUArchState, ras_top));
+    tcg_gen_ext_i32_ptr(ptr, t32);
+    tcg_gen_add_ptr(ptr, ptr, cpu_env);
+    tcg_gen_subi_i32(t32, t32, sizeof(CPURASEntry));
+    tcg_gen_andi_i32(t32, t32, sizeof(CPURASEntry) * CPU_RAS_SIZE - 1);
+    tcg_gen_st_i32(t32, cpu_env, offsetof(CPUArchState, ras_top));
+    tcg_gen_ld_i32(t32, ptr, offsetof(CPUArchState, ras[0].jmp_cache_ofs));
+    tcg_gen_ld_tl(t, ptr, offsetof(CPUArchState, ras[0].pc));
+    tcg_gen_ext_i32_ptr(ptr, t32);
+    tcg_gen_add_ptr(ptr, ptr, cpu_env);
+    tcg_gen_ld_ptr(tb, ptr, 0);
+    tcg_gen_brcond_tl(TCG_COND_NE, t, lpc, miss);
+
+    /* Validate the TB in its tb_jmp_cache slot as tb_lookup__cpu_state()
+       does.  There is no need to compare trace_vcpu_dstate: the cache is
+       cleared whenever the vCPU's tracing state changes.  */
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, tb, 0, miss);
+    tcg_gen_ld_tl(t, tb, offsetof(TranslationBlock, pc));
+    tcg_gen_brcond_tl(TCG_COND_NE, t, lpc, miss);
+    tcg_gen_ld_tl(t, tb, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_tl(TCG_COND_NE, t, cs_base, miss);
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, flags, miss);
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, cflags));
+    tcg_gen_andi_i32(t32, t32, CF_HASH_MASK | CF_INVALID);
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32,
+                        tcg_ctx->tb_cflags & CF_HASH_MASK, miss);
+    tcg_gen_ld_ptr(ptr, tb, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+
+    gen_set_label(miss);
+    tcg_gen_lookup_and_goto_ptr();
+
+    tcg_temp_free_ptr(tb);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(t32);
+    tcg_temp_free(t);
+    tcg_temp_free(lpc);
+}
+
 static inline TCGMemOp tcg_canonicalize_memop(TCGMemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
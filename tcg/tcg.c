@@ -59,6 +59,7 @@
 #include "elf.h"
 #include "exec/log.h"
 #include "sysemu/sysemu.h"
+#include "perf.h"
 
 /* Forward declarations for functions declared in tcg-target.inc.c and
    used here. */
@@ -106,6 +107,18 @@ static void tcg_out_movi(TCGContext *s, TCGType type,
                          TCGReg ret, tcg_target_long arg);
 static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
                        const int *const_args);
+#if TCG_TARGET_MAYBE_vec
+static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc, unsigned vecl,
+                           unsigned vece, const TCGArg *args,
+                           const int *const_args);
+#else
+static inline void tcg_out_vec_op(TCGContext *s, TCGOpcode opc, unsigned vecl,
+                                  unsigned vece, const TCGArg *args,
+                                  const int *const_args)
+{
+    g_assert_not_reached();
+}
+#endif
 static void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg, TCGReg arg1,
                        intptr_t arg2);
 static bool tcg_out_sti(TCGContext *s, TCGType type, TCGArg val,
@@ -116,6 +129,9 @@ static int tcg_target_const_match(tcg_target_long val, TCGType type,
 #ifdef TCG_TARGET_NEED_LDST_LABELS
 static bool tcg_out_ldst_finalize(TCGContext *s);
 #endif
+#ifdef TCG_TARGET_NEED_SUPERINSNS
+static void tcg_out_superinsns(TCGContext *s);
+#endif
 
 #define TCG_HIGHWATER 1024
 
@@ -139,15 +155,33 @@ struct tcg_region_state {
     size_t n;
     size_t size; /* size of one region */
     size_t stride; /* .size + guard size */
+    bool evict; /* evict single regions instead of flushing them all */
+    size_t hpage_size; /* if nonzero, align regions to huge pages */
 
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /* eviction mode only, see tcg_region_evict() */
+    size_t *queue; /* allocated regions, oldest first; circular */
+    size_t queue_head;
+    size_t queue_len;
+    size_t *free_regions; /* evicted regions, ready to be allocated again */
+    size_t n_free;
+    size_t *uses; /* per-region count from tcg_region_note_use() */
+    size_t n_evicted;
 };
 
 static struct tcg_region_state region;
+/*
+ * This is an array of struct tcg_region_tree's, with padding.
+ * We use void * to simplify the computation of region_trees[i]; each
+ * struct is found every tree_size bytes.
+ */
+static void *region_trees;
+static size_t tree_size;
 
-static TCGRegSet tcg_target_available_regs[2];
+static TCGRegSet tcg_target_available_regs[TCG_TYPE_COUNT];
 static TCGRegSet tcg_target_call_clobber_regs;
 
 #if TCG_TARGET_INSN_UNIT_SIZE == 1
@@ -314,13 +348,238 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
+static size_t tcg_region_index(const void *p)
+{
+    size_t idx;
+
+    /* the first region starts before start_aligned */
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    idx = (p - region.start_aligned) / region.stride;
+    /* the last region may extend past n * stride */
+    return MIN(idx, region.n - 1);
+}
+
+/*
+ * The TBs of each region are kept in a binary search tree of their own,
+ * so that threads translating into different regions do not contend on
+ * a lock when inserting TBs.
+ */
+struct tcg_region_tree {
+    QemuMutex lock;
+    GTree *tree;
+    /* padding to avoid false sharing is computed at run-time */
+};
+
+/* compare a pointer @ptr and a tb_tc @s */
+static int ptr_cmp_tb_tc(const void *ptr, const struct tb_tc *s)
+{
+    if (ptr >= s->ptr + s->size) {
+        return 1;
+    } else if (ptr < s->ptr) {
+        return -1;
+    }
+    return 0;
+}
+
+static gint tb_tc_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const struct tb_tc *a = ap;
+    const struct tb_tc *b = bp;
+
+    /*
+     * When both sizes are set, we know this isn't a lookup.
+     * This is the most likely case: every TB must be inserted; lookups
+     * are a lot less frequent.
+     */
+    if (likely(a->size && b->size)) {
+        if (a->ptr > b->ptr) {
+            return 1;
+        } else if (a->ptr < b->ptr) {
+            return -1;
+        }
+        /* a->ptr == b->ptr should happen only on deletions */
+        g_assert(a->size == b->size);
+        return 0;
+    }
+    /*
+     * All lookups have either .size field set to 0.
+     * From the glib sources we see that @ap is always the lookup key. However
+     * the docs provide no guarantee, so we just mark this case as likely.
+     */
+    if (likely(a->size == 0)) {
+        return ptr_cmp_tb_tc(a->ptr, b);
+    }
+    return ptr_cmp_tb_tc(b->ptr, a);
+}
+
+static void tcg_region_trees_init(void)
+{
+    size_t i;
+
+    tree_size = ROUND_UP(sizeof(struct tcg_region_tree), qemu_dcache_linesize);
+    region_trees = qemu_memalign(qemu_dcache_linesize, region.n * tree_size);
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        qemu_mutex_init(&rt->lock);
+        rt->tree = g_tree_new(tb_tc_cmp);
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    return region_trees + tcg_region_index(p) * tree_size;
+}
+
+void tcg_tb_insert(TranslationBlock *tb)
+{
+    struct tcg_region_tree *rt = tc_ptr_to_region_tree(tb->tc.ptr);
+
+    qemu_mutex_lock(&rt->lock);
+    g_tree_insert(rt->tree, &tb->tc, tb);
+    qemu_mutex_unlock(&rt->lock);
+}
+
+void tcg_tb_remove(TranslationBlock *tb)
+{
+    struct tcg_region_tree *rt = tc_ptr_to_region_tree(tb->tc.ptr);
+
+    qemu_mutex_lock(&rt->lock);
+    g_tree_remove(rt->tree, &tb->tc);
+    qemu_mutex_unlock(&rt->lock);
+}
+
+/*
+ * Find the TB 'tb' such that
+ * tb->tc.ptr <= tc_ptr < tb->tc.ptr + tb->tc.size
+ * Return NULL if not found.
+ */
+TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr)
+{
+    struct tcg_region_tree *rt = tc_ptr_to_region_tree((void *)tc_ptr);
+    TranslationBlock *tb;
+    struct tb_tc s = { .ptr = (void *)tc_ptr };
+
+    qemu_mutex_lock(&rt->lock);
+    tb = g_tree_lookup(rt->tree, &s);
+    qemu_mutex_unlock(&rt->lock);
+    return tb;
+}
+
+static void tcg_region_tree_lock_all(void)
+{
+    size_t i;
+
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        qemu_mutex_lock(&rt->lock);
+    }
+}
+
+static void tcg_region_tree_unlock_all(void)
+{
+    size_t i;
+
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        qemu_mutex_unlock(&rt->lock);
+    }
+}
+
+/*
+ * Call @func on every TB, in the order of their translated code, while
+ * holding all tree locks.  @func must not insert or remove TBs.
+ */
+void tcg_tb_foreach(GTraverseFunc func, gpointer user_data)
+{
+    size_t i;
+
+    tcg_region_tree_lock_all();
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        g_tree_foreach(rt->tree, func, user_data);
+    }
+    tcg_region_tree_unlock_all();
+}
+
+/* Like tcg_tb_foreach, but only for the TBs in the region containing @p.  */
+void tcg_region_tb_foreach(const void *p, GTraverseFunc func,
+                           gpointer user_data)
+{
+    struct tcg_region_tree *rt = tc_ptr_to_region_tree(p);
+
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, func, user_data);
+    qemu_mutex_unlock(&rt->lock);
+}
+
+size_t tcg_nb_tbs(void)
+{
+    size_t nb_tbs = 0;
+    size_t i;
+
+    tcg_region_tree_lock_all();
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        nb_tbs += g_tree_nnodes(rt->tree);
+    }
+    tcg_region_tree_unlock_all();
+    return nb_tbs;
+}
+
+static void tcg_region_tree_reset_all(void)
+{
+    size_t i;
+
+    tcg_region_tree_lock_all();
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+    }
+    tcg_region_tree_unlock_all();
+}
+
+static void tcg_region_queue_push(size_t curr_region)
+{
+    size_t tail = (region.queue_head + region.queue_len) % region.n;
+
+    region.queue[tail] = curr_region;
+    region.queue_len++;
+}
+
+static size_t tcg_region_queue_pop(void)
+{
+    size_t curr_region = region.queue[region.queue_head];
+
+    region.queue_head = (region.queue_head + 1) % region.n;
+    region.queue_len--;
+    return curr_region;
+}
+
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t curr_region;
+
+    if (region.current < region.n) {
+        curr_region = region.current++;
+    } else if (region.n_free) {
+        curr_region = region.free_regions[--region.n_free];
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, curr_region);
+    if (region.evict) {
+        tcg_region_queue_push(curr_region);
+    }
     return false;
 }
 
@@ -361,6 +620,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.queue_head = 0;
+    region.queue_len = 0;
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -369,6 +631,133 @@ void tcg_region_reset_all(void)
         g_assert(!err);
     }
     qemu_mutex_unlock(&region.lock);
+
+    tcg_region_tree_reset_all();
+}
+
+/*
+ * Region eviction selects the oldest region that is neither in use by a
+ * TCG context nor hot, i.e. holding more than the average share of the
+ * TBs passed to tcg_region_note_use().  Hot regions and regions in use
+ * are moved to the back of the queue.  Since at least one candidate is
+ * never above the average, a victim is found in a single pass over the
+ * queue unless all regions are in use.
+ *
+ * The victim's bounds are returned in @pstart and @pend, and it becomes
+ * available for allocation again; the caller must discard the TBs in it
+ * before any new code is generated.
+ *
+ * Returns false if no region could be evicted.
+ * Call from a safe-work context.
+ */
+bool tcg_region_evict(void **pstart, void **pend)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    bool *in_use = g_new0(bool, region.n);
+    size_t n_candidates = 0;
+    size_t total_uses = 0;
+    size_t i, curr_region;
+    bool found = false;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        in_use[tcg_region_index(s->code_gen_buffer)] = true;
+    }
+    for (i = 0; i < region.queue_len; i++) {
+        curr_region = region.queue[(region.queue_head + i) % region.n];
+        if (!in_use[curr_region]) {
+            n_candidates++;
+            total_uses += region.uses[curr_region];
+        }
+    }
+    for (i = 0; i < region.queue_len && n_candidates; i++) {
+        curr_region = tcg_region_queue_pop();
+        if (!in_use[curr_region] &&
+            region.uses[curr_region] * n_candidates <= total_uses) {
+            found = true;
+            break;
+        }
+        tcg_region_queue_push(curr_region);
+    }
+    if (found) {
+        tcg_region_bounds(curr_region, pstart, pend);
+        region.free_regions[region.n_free++] = curr_region;
+        region.agg_size_full -= *pend - *pstart - TCG_HIGHWATER;
+        region.n_evicted++;
+    }
+    memset(region.uses, 0, region.n * sizeof(*region.uses));
+    qemu_mutex_unlock(&region.lock);
+
+    g_free(in_use);
+    return found;
+}
+
+/*
+ * Record that the TB at @p was used recently.  Feeds the hotness
+ * heuristic of tcg_region_evict(); only meaningful in eviction mode.
+ * Call from a safe-work context.
+ */
+void tcg_region_note_use(const void *p)
+{
+    region.uses[tcg_region_index(p)]++;
+}
+
+/*
+ * Select eviction mode: when the buffer fills up, free one region at a
+ * time with tcg_region_evict() rather than flushing all of them.
+ * Must be called before tcg_region_init().
+ */
+void tcg_region_set_evict(bool evict)
+{
+    region.evict = evict;
+}
+
+/*
+ * Align the regions to transparent huge pages, so that the guard page at
+ * the end of each region only splits the last huge page of it.
+ * Must be called before tcg_region_init().
+ */
+void tcg_region_set_hugepages(bool enable)
+{
+    region.hpage_size = 0;
+#ifdef CONFIG_LINUX
+    if (enable && QEMU_VMALLOC_ALIGN > qemu_real_host_page_size) {
+        region.hpage_size = QEMU_VMALLOC_ALIGN;
+    }
+#endif
+}
+
+bool tcg_region_evict_enabled(void)
+{
+    return region.evict;
+}
+
+size_t tcg_region_evict_count(void)
+{
+    size_t n;
+
+    qemu_mutex_lock(&region.lock);
+    n = region.n_evicted;
+    qemu_mutex_unlock(&region.lock);
+    return n;
+}
+
+/*
+ * In eviction mode, aim for regions of about 2 MB, so that evicting one
+ * of them discards a small fraction of the translated code.  Keep at
+ * least a few of them even with a small buffer.  With huge pages, make
+ * them four huge pages long, since the guard page splits the last one.
+ */
+static size_t tcg_n_evict_regions(size_t n_regions)
+{
+    size_t n = MAX(2 * 1024u * 1024, 4 * region.hpage_size);
+
+    n = tcg_init_ctx.code_gen_buffer_size / n;
+
+    n = MIN(MAX(n, 4), 64);
+    return MAX(n, n_regions);
 }
 
 #ifdef CONFIG_USER_ONLY
@@ -443,22 +832,37 @@ void tcg_region_init(void)
     void *aligned;
     size_t size = tcg_init_ctx.code_gen_buffer_size;
     size_t page_size = qemu_real_host_page_size;
+    size_t align = region.hpage_size;
     size_t region_size;
     size_t n_regions;
     size_t i;
 
     n_regions = tcg_n_regions();
+    if (region.evict) {
+        n_regions = tcg_n_evict_regions(n_regions);
+    }
 
-    /* The first region will be 'aligned - buf' bytes larger than the others */
-    aligned = QEMU_ALIGN_PTR_UP(buf, page_size);
+    /*
+     * With huge pages, start the regions on a huge page boundary and make
+     * their size a multiple of it, so that each guard page only splits the
+     * last huge page of its region.  The part of the buffer below that
+     * boundary is left unused.  Fall back to plain pages if that leaves
+     * fewer than two huge pages per region.
+     */
+    if (align < page_size || size / n_regions < 2 * align) {
+        align = page_size;
+    }
+
+    /* Otherwise the first region is 'aligned - buf' bytes larger */
+    aligned = QEMU_ALIGN_PTR_UP(buf, align);
     g_assert(aligned < tcg_init_ctx.code_gen_buffer + size);
     /*
-     * Make region_size a multiple of page_size, using aligned as the start.
+     * Make region_size a multiple of align, using aligned as the start.
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
     region_size = (size - (aligned - buf)) / n_regions;
-    region_size = QEMU_ALIGN_DOWN(region_size, page_size);
+    region_size = QEMU_ALIGN_DOWN(region_size, align);
 
     /* A region must have at least 2 pages; one code, one guard */
     g_assert(region_size >= 2 * page_size);
@@ -468,13 +872,21 @@ void tcg_region_init(void)
     region.n = n_regions;
     region.size = region_size - page_size;
     region.stride = region_size;
-    region.start = buf;
+    region.start = align > page_size ? aligned : buf;
     region.start_aligned = aligned;
     /* page-align the end, since its last page will be a guard page */
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
     region.end -= page_size;
 
+    if (region.evict) {
+        region.queue = g_new(size_t, region.n);
+        region.free_regions = g_new(size_t, region.n);
+        region.uses = g_new0(size_t, region.n);
+    }
+
+    tcg_region_trees_init();
+
     /* set guard pages */
     for (i = 0; i < region.n; i++) {
         void *start, *end;
@@ -655,6 +1067,7 @@ static const TCGHelperInfo all_helpers[] = {
 #include "exec/helper-tcg.h"
 };
 static GHashTable *helper_table;
+static GHashTable *helper_expansions;
 
 static int indirect_reg_alloc_order[ARRAY_SIZE(tcg_target_reg_alloc_order)];
 static void process_op_defs(TCGContext *s);
@@ -701,6 +1114,7 @@ void tcg_context_init(TCGContext *s)
         g_hash_table_insert(helper_table, (gpointer)all_helpers[i].func,
                             (gpointer)&all_helpers[i]);
     }
+    helper_expansions = g_hash_table_new(NULL, NULL);
 
     tcg_target_init(s);
     process_op_defs(s);
@@ -809,6 +1223,7 @@ void tcg_prologue_init(TCGContext *s)
     s->code_gen_buffer_size = total_size;
 
     tcg_register_jit(s->code_gen_buffer, total_size);
+    perf_report_prologue(buf0, prologue_size);
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM)) {
@@ -1026,6 +1441,41 @@ TCGv_i64 tcg_temp_new_internal_i64(int temp_local)
     return temp_tcgv_i64(t);
 }
 
+TCGv_vec tcg_temp_new_vec(TCGType type)
+{
+    TCGTemp *t;
+
+#ifdef CONFIG_DEBUG_TCG
+    switch (type) {
+    case TCG_TYPE_V64:
+        assert(TCG_TARGET_HAS_v64);
+        break;
+    case TCG_TYPE_V128:
+        assert(TCG_TARGET_HAS_v128);
+        break;
+    case TCG_TYPE_V256:
+        assert(TCG_TARGET_HAS_v256);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+#endif
+
+    t = tcg_temp_new_internal(type, 0);
+    return temp_tcgv_vec(t);
+}
+
+/* Create a new temp of the same type as an existing temp.  */
+TCGv_vec tcg_temp_new_vec_matching(TCGv_vec match)
+{
+    TCGTemp *t = tcgv_vec_temp(match);
+
+    tcg_debug_assert(t->temp_allocated != 0);
+
+    t = tcg_temp_new_internal(t->base_type, 0);
+    return temp_tcgv_vec(t);
+}
+
 static void tcg_temp_free_internal(TCGTemp *ts)
 {
     TCGContext *s = tcg_ctx;
@@ -1057,6 +1507,11 @@ void tcg_temp_free_i64(TCGv_i64 arg)
     tcg_temp_free_internal(tcgv_i64_temp(arg));
 }
 
+void tcg_temp_free_vec(TCGv_vec arg)
+{
+    tcg_temp_free_internal(tcgv_vec_temp(arg));
+}
+
 TCGv_i32 tcg_const_i32(int32_t val)
 {
     TCGv_i32 t0;
@@ -1327,12 +1782,41 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_mulsh_i64:
         return TCG_TARGET_HAS_mulsh_i64;
 
+    case INDEX_op_mov_vec:
+    case INDEX_op_dup_vec:
+    case INDEX_op_dupi_vec:
+    case INDEX_op_ld_vec:
+    case INDEX_op_st_vec:
+    case INDEX_op_add_vec:
+    case INDEX_op_sub_vec:
+    case INDEX_op_and_vec:
+    case INDEX_op_or_vec:
+    case INDEX_op_xor_vec:
+        return TCG_TARGET_MAYBE_vec;
+    case INDEX_op_andc_vec:
+        return TCG_TARGET_HAS_andc_vec;
+    case INDEX_op_not_vec:
+        return TCG_TARGET_HAS_not_vec;
+    case INDEX_op_neg_vec:
+        return TCG_TARGET_HAS_neg_vec;
+
     case NB_OPS:
         break;
     }
     g_assert_not_reached();
 }
 
+/* Register EXPAND to be emitted instead of calls to the helper FUNC,
+   which must have been declared with TCG_CALL_INLINE.  This must be
+   done before the first translation, e.g. by the target's TCG init.  */
+void tcg_register_helper_expansion(void *func, TCGHelperExpansion *expand)
+{
+    TCGHelperInfo *info = g_hash_table_lookup(helper_table, func);
+
+    tcg_debug_assert(info && (info->flags & TCG_CALL_INLINE));
+    g_hash_table_insert(helper_expansions, func, expand);
+}
+
 /* Note: we convert the 64 bit args to 32 bit and do some alignment
    and endian swap. Maybe it would be better to do the alignment
    and endian swap in tcg_reg_alloc_call(). */
@@ -1347,6 +1831,16 @@ void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args)
     flags = info->flags;
     sizemask = info->sizemask;
 
+    if (flags & TCG_CALL_INLINE) {
+        TCGHelperExpansion *expand;
+
+        expand = g_hash_table_lookup(helper_expansions, (gpointer)func);
+        if (expand) {
+            expand(ret, args);
+            return;
+        }
+    }
+
 #if defined(__sparc__) && !defined(__arch64__) \
     && !defined(CONFIG_TCG_INTERPRETER)
     /* We have 64-bit values in one register, but need to pass as two
@@ -1661,6 +2155,11 @@ void tcg_dump_ops(TCGContext *s)
             nb_iargs = def->nb_iargs;
             nb_cargs = def->nb_cargs;
 
+            if (def->flags & TCG_OPF_VECTOR) {
+                col += qemu_log("v%d,e%d,", 64 << TCGOP_VECL(op),
+                                8 << TCGOP_VECE(op));
+            }
+
             k = 0;
             for (i = 0; i < nb_oargs; i++) {
                 if (k != 0) {
@@ -1938,6 +2437,168 @@ TCGOp *tcg_op_insert_after(TCGContext *s, TCGOp *old_op,
 #define IS_DEAD_ARG(n)   (arg_life & (DEAD_ARG << (n)))
 #define NEED_SYNC_ARG(n) (arg_life & (SYNC_ARG << (n)))
 
+/* Internal labels may keep a few globals in host registers: every edge
+   into the label delivers them in the same registers, so the block
+   after the label need not reload them from env.  Values whose copy in
+   env may be stale on some edge are marked dirty; they are written back
+   after the label only if liveness says memory is needed there.  */
+#define TCG_MAX_LABEL_REGS   6
+/* Registers left to the allocator at a branch with label registers.  */
+#define TCG_LABEL_REGS_SPARE 6
+
+struct TCGLabelRegs {
+    int n;
+    bool defined;
+    TCGOp *label_op;
+    TCGTemp *temps[TCG_MAX_LABEL_REGS];
+    TCGReg regs[TCG_MAX_LABEL_REGS];
+    bool dirty[TCG_MAX_LABEL_REGS];
+    uint8_t entry_state[TCG_MAX_LABEL_REGS];
+};
+
+/* Return the label defined or branched to by OP, if any.  */
+static TCGLabel *tcg_op_label(const TCGOp *op)
+{
+    switch (op->opc) {
+    case INDEX_op_set_label:
+    case INDEX_op_br:
+        return arg_label(op->args[0]);
+    case INDEX_op_brcond_i32:
+    case INDEX_op_brcond_i64:
+        return arg_label(op->args[3]);
+    case INDEX_op_brcond2_i32:
+        return arg_label(op->args[5]);
+    default:
+        return NULL;
+    }
+}
+
+static bool label_regs_candidate(const TCGTemp *ts)
+{
+    return ts->temp_global && !ts->fixed_reg
+        && !ts->indirect_reg && !ts->indirect_base
+        && (ts->type == TCG_TYPE_I32 || ts->type == TCG_TYPE_I64);
+}
+
+static int label_regs_find(const TCGLabelRegs *r, const TCGTemp *ts)
+{
+    int i;
+
+    for (i = 0; i < r->n; i++) {
+        if (r->temps[i] == ts) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void op_get_nb_args(const TCGOp *op, int *nb_oargs, int *nb_iargs)
+{
+    if (op->opc == INDEX_op_call) {
+        *nb_oargs = TCGOP_CALLO(op);
+        *nb_iargs = TCGOP_CALLI(op);
+    } else {
+        *nb_oargs = tcg_op_defs[op->opc].nb_oargs;
+        *nb_iargs = tcg_op_defs[op->opc].nb_iargs;
+    }
+}
+
+/* Collect the globals read before being written in the block that
+   starts at the set_label LABEL_OP.  */
+static TCGLabelRegs *label_regs_scan(TCGOp *label_op, int max)
+{
+    TCGTemp *written[16];
+    int n_written = 0;
+    TCGLabelRegs *r = NULL;
+    TCGOp *op;
+
+    for (op = QTAILQ_NEXT(label_op, link); op; op = QTAILQ_NEXT(op, link)) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        int i, j, nb_oargs, nb_iargs;
+
+        if (op->opc == INDEX_op_call || (def->flags & TCG_OPF_BB_END)) {
+            break;
+        }
+        op_get_nb_args(op, &nb_oargs, &nb_iargs);
+        for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+
+            if (!label_regs_candidate(ts)) {
+                continue;
+            }
+            for (j = 0; j < n_written; j++) {
+                if (written[j] == ts) {
+                    break;
+                }
+            }
+            if (j < n_written) {
+                continue;
+            }
+            if (r == NULL) {
+                r = tcg_malloc(sizeof(TCGLabelRegs));
+                memset(r, 0, sizeof(TCGLabelRegs));
+                r->label_op = label_op;
+            }
+            if (label_regs_find(r, ts) < 0) {
+                r->temps[r->n++] = ts;
+                if (r->n == max) {
+                    return r;
+                }
+            }
+        }
+        for (i = 0; i < nb_oargs; i++) {
+            if (n_written == ARRAY_SIZE(written)) {
+                return r;
+            }
+            written[n_written++] = arg_temp(op->args[i]);
+        }
+    }
+    return r;
+}
+
+/* Choose the globals to keep in registers across each internal label.
+   For a backward branch, the globals written inside the loop start out
+   dirty so that the back edge does not have to store them.  */
+static void label_regs_pass(TCGContext *s)
+{
+    TCGRegSet avail = (tcg_target_available_regs[TCG_TYPE_I32]
+                       & ~s->reserved_regs);
+    int max = MIN(TCG_MAX_LABEL_REGS, ctpop64(avail) - TCG_LABEL_REGS_SPARE);
+    TCGOp *op, *op2;
+
+    if (max <= 0) {
+        return;
+    }
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        TCGLabel *l = tcg_op_label(op);
+        TCGLabelRegs *r;
+
+        if (l == NULL) {
+            continue;
+        }
+        if (op->opc == INDEX_op_set_label) {
+            l->regs = label_regs_scan(op, max);
+            continue;
+        }
+        r = l->regs;
+        if (r == NULL) {
+            continue;
+        }
+        for (op2 = r->label_op; op2 != op; op2 = QTAILQ_NEXT(op2, link)) {
+            int i, j, nb_oargs, nb_iargs;
+
+            op_get_nb_args(op2, &nb_oargs, &nb_iargs);
+            for (i = 0; i < nb_oargs; i++) {
+                j = label_regs_find(r, arg_temp(op2->args[i]));
+                if (j >= 0) {
+                    r->dirty[j] = true;
+                }
+            }
+        }
+    }
+}
+
 /* liveness analysis: end of function: all temps are dead, and globals
    should be in memory. */
 static void tcg_la_func_end(TCGContext *s)
@@ -1972,6 +2633,25 @@ static void tcg_la_bb_end(TCGContext *s)
     }
 }
 
+/* liveness analysis: end of basic block at a label with registers (or a
+   branch to it): like tcg_la_bb_end, except that the label's globals
+   are live in registers and need not be in memory.  */
+static void tcg_la_label_regs(TCGContext *s, const TCGOp *op,
+                              TCGLabelRegs *r)
+{
+    int i;
+
+    if (op->opc == INDEX_op_set_label) {
+        for (i = 0; i < r->n; i++) {
+            r->entry_state[i] = r->temps[i]->state;
+        }
+    }
+    tcg_la_bb_end(s);
+    for (i = 0; i < r->n; i++) {
+        r->temps[i]->state = 0;
+    }
+}
+
 /* Liveness analysis : update the opc_arg_life array to tell if a
    given input arguments is dead. Instructions updating dead
    temporaries are removed. */
@@ -2171,7 +2851,13 @@ static void liveness_pass_1(TCGContext *s)
 
                 /* if end of basic block, update */
                 if (def->flags & TCG_OPF_BB_END) {
-                    tcg_la_bb_end(s);
+                    TCGLabel *l = tcg_op_label(op);
+
+                    if (l && l->regs) {
+                        tcg_la_label_regs(s, op, l->regs);
+                    } else {
+                        tcg_la_bb_end(s);
+                    }
                 } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
                     /* globals should be synced to memory */
                     for (i = 0; i < nb_globals; i++) {
@@ -2424,20 +3110,35 @@ static void check_regs(TCGContext *s)
 
 static void temp_allocate_frame(TCGContext *s, TCGTemp *ts)
 {
+    tcg_target_long size, align;
+
+    switch (ts->type) {
+    case TCG_TYPE_V64:
+        size = align = 8;
+        break;
+    case TCG_TYPE_V128:
+    case TCG_TYPE_V256:
+        /* The frame is only guaranteed to be 16-byte aligned.  */
+        size = ts->type == TCG_TYPE_V128 ? 16 : 32;
+        align = 16;
+        break;
+    default:
+        size = align = sizeof(tcg_target_long);
+        break;
+    }
+
 #if !(defined(__sparc__) && TCG_TARGET_REG_BITS == 64)
     /* Sparc64 stack is accessed with offset of 2047 */
-    s->current_frame_offset = (s->current_frame_offset +
-                               (tcg_target_long)sizeof(tcg_target_long) - 1) &
-        ~(sizeof(tcg_target_long) - 1);
+    s->current_frame_offset = (s->current_frame_offset + align - 1) &
+        ~(align - 1);
 #endif
-    if (s->current_frame_offset + (tcg_target_long)sizeof(tcg_target_long) >
-        s->frame_end) {
+    if (s->current_frame_offset + size > s->frame_end) {
         tcg_abort();
     }
     ts->mem_offset = s->current_frame_offset;
     ts->mem_base = s->frame_temp;
     ts->mem_allocated = 1;
-    s->current_frame_offset += sizeof(tcg_target_long);
+    s->current_frame_offset += size;
 }
 
 static void temp_load(TCGContext *, TCGTemp *, TCGRegSet, TCGRegSet);
@@ -2617,8 +3318,10 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
 }
 
 /* at the end of a basic block, we assume all temporaries are dead and
-   all globals are stored at their canonical location. */
-static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
+   all globals are stored at their canonical location, except for the
+   globals that the label KEEP holds in registers. */
+static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs,
+                                 const TCGLabelRegs *keep)
 {
     int i;
 
@@ -2633,7 +3336,179 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
         }
     }
 
-    save_globals(s, allocated_regs);
+    if (keep == NULL) {
+        save_globals(s, allocated_regs);
+        return;
+    }
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+        if (label_regs_find(keep, ts) < 0) {
+            temp_save(s, ts, allocated_regs);
+        }
+    }
+}
+
+/* Move TS into REG, spilling whatever REG holds.  */
+static void temp_load_to(TCGContext *s, TCGTemp *ts, TCGReg reg,
+                         TCGRegSet allocated_regs)
+{
+    if (ts->val_type == TEMP_VAL_REG && ts->reg == reg) {
+        return;
+    }
+    tcg_reg_free(s, reg, allocated_regs);
+
+    switch (ts->val_type) {
+    case TEMP_VAL_REG:
+        tcg_out_mov(s, ts->type, reg, ts->reg);
+        s->reg_to_temp[ts->reg] = NULL;
+        break;
+    case TEMP_VAL_CONST:
+        tcg_out_movi(s, ts->type, reg, ts->val);
+        break;
+    case TEMP_VAL_MEM:
+        tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
+        ts->mem_coherent = 1;
+        break;
+    case TEMP_VAL_DEAD:
+    default:
+        tcg_abort();
+    }
+    ts->reg = reg;
+    ts->val_type = TEMP_VAL_REG;
+    s->reg_to_temp[reg] = ts;
+}
+
+/* Pick the registers of a label, preferring those its globals are
+   already in.  */
+static void label_regs_define(TCGContext *s, TCGLabelRegs *r)
+{
+    TCGRegSet taken = s->reserved_regs;
+    int i;
+
+    for (i = 0; i < r->n; i++) {
+        TCGTemp *ts = r->temps[i];
+
+        r->regs[i] = TCG_REG_CALL_STACK;
+        if (ts->val_type == TEMP_VAL_REG
+            && tcg_regset_test_reg(tcg_target_available_regs[ts->type],
+                                   ts->reg)
+            && !tcg_regset_test_reg(taken, ts->reg)) {
+            r->regs[i] = ts->reg;
+            tcg_regset_set_reg(taken, ts->reg);
+        }
+    }
+    for (i = 0; i < r->n; i++) {
+        TCGTemp *ts = r->temps[i];
+
+        if (r->regs[i] == TCG_REG_CALL_STACK) {
+            r->regs[i] = tcg_reg_alloc(s, tcg_target_available_regs[ts->type],
+                                       taken, false);
+            tcg_regset_set_reg(taken, r->regs[i]);
+        }
+    }
+    r->defined = true;
+}
+
+/* Bring the globals of a label into its registers, and return the set
+   of those registers.  */
+static TCGRegSet label_regs_conform(TCGContext *s, TCGLabelRegs *r)
+{
+    TCGRegSet allocated_regs = s->reserved_regs;
+    int i;
+
+    if (!r->defined) {
+        label_regs_define(s, r);
+    }
+    for (i = 0; i < r->n; i++) {
+        tcg_regset_set_reg(allocated_regs, r->regs[i]);
+    }
+    for (i = 0; i < r->n; i++) {
+        temp_load_to(s, r->temps[i], r->regs[i], allocated_regs);
+    }
+    return allocated_regs;
+}
+
+/* A branch to L: the globals of L go to its registers.  A value that
+   is not in memory yet is written back now, unless L already accepts
+   a dirty copy, or the branch is unconditional and L has not been
+   emitted yet; in that case it is left to L.  */
+static TCGRegSet tcg_reg_alloc_branch_regs(TCGContext *s, TCGLabel *l,
+                                           bool cond)
+{
+    TCGLabelRegs *r = l->regs;
+    TCGRegSet allocated_regs = label_regs_conform(s, r);
+    int i;
+
+    for (i = 0; i < r->n; i++) {
+        TCGTemp *ts = r->temps[i];
+
+        if (ts->mem_coherent || r->dirty[i]) {
+            continue;
+        }
+        if (cond || l->has_value) {
+            temp_sync(s, ts, allocated_regs, 0);
+        } else {
+            r->dirty[i] = true;
+        }
+    }
+    return allocated_regs;
+}
+
+static void tcg_reg_alloc_label(TCGContext *s, TCGLabel *l, bool fallthrough)
+{
+    TCGLabelRegs *r = l->regs;
+    TCGRegSet allocated_regs = s->reserved_regs;
+    int i;
+
+    if (r == NULL) {
+        tcg_reg_alloc_bb_end(s, allocated_regs, NULL);
+        tcg_out_label(s, l, s->code_ptr);
+        return;
+    }
+
+    if (fallthrough) {
+        allocated_regs = label_regs_conform(s, r);
+        for (i = 0; i < r->n; i++) {
+            r->dirty[i] |= !r->temps[i]->mem_coherent;
+        }
+    } else {
+        if (!r->defined) {
+            label_regs_define(s, r);
+        }
+        for (i = 0; i < r->n; i++) {
+            tcg_regset_set_reg(allocated_regs, r->regs[i]);
+        }
+    }
+    tcg_reg_alloc_bb_end(s, allocated_regs, r);
+    tcg_out_label(s, l, s->code_ptr);
+
+    /* Drop all the old mappings before installing the new ones, since
+       the globals may have swapped registers.  */
+    for (i = 0; i < r->n; i++) {
+        TCGTemp *ts = r->temps[i];
+
+        if (ts->val_type == TEMP_VAL_REG) {
+            s->reg_to_temp[ts->reg] = NULL;
+        }
+    }
+    for (i = 0; i < r->n; i++) {
+        TCGTemp *ts = r->temps[i];
+
+        ts->val_type = TEMP_VAL_REG;
+        ts->reg = r->regs[i];
+        ts->mem_coherent = !r->dirty[i];
+        s->reg_to_temp[ts->reg] = ts;
+    }
+    for (i = 0; i < r->n; i++) {
+        TCGTemp *ts = r->temps[i];
+        int state = r->entry_state[i];
+
+        if ((state & TS_MEM) && !ts->mem_coherent) {
+            temp_sync(s, ts, allocated_regs, state & TS_DEAD);
+        } else if (state & TS_DEAD) {
+            temp_dead(s, ts);
+        }
+    }
 }
 
 static void tcg_reg_alloc_do_movi(TCGContext *s, TCGTemp *ots,
@@ -2753,6 +3628,7 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
     TCGTemp *ts;
     TCGArg new_args[TCG_MAX_OP_ARGS];
     int const_args[TCG_MAX_OP_ARGS];
+    TCGLabelRegs *keep = NULL;
 
     nb_oargs = def->nb_oargs;
     nb_iargs = def->nb_iargs;
@@ -2765,6 +3641,16 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
     i_allocated_regs = s->reserved_regs;
     o_allocated_regs = s->reserved_regs;
 
+    if (def->flags & TCG_OPF_BB_END) {
+        TCGLabel *l = tcg_op_label(op);
+        bool cond = op->opc != INDEX_op_br;
+
+        if (l && l->regs) {
+            keep = l->regs;
+            i_allocated_regs = tcg_reg_alloc_branch_regs(s, l, cond);
+        }
+    }
+
     /* satisfy input constraints */ 
     for (k = 0; k < nb_iargs; k++) {
         i = def->sorted_args[nb_oargs + k];
@@ -2832,7 +3718,7 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
     }
 
     if (def->flags & TCG_OPF_BB_END) {
-        tcg_reg_alloc_bb_end(s, i_allocated_regs);
+        tcg_reg_alloc_bb_end(s, i_allocated_regs, keep);
     } else {
         if (def->flags & TCG_OPF_CALL_CLOBBER) {
             /* XXX: permit generic clobber register list ? */ 
@@ -2890,8 +3776,27 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
     }
 
     /* emit instruction */
-    tcg_out_op(s, op->opc, new_args, const_args);
-    
+    if (def->flags & TCG_OPF_VECTOR) {
+        tcg_out_vec_op(s, op->opc, TCGOP_VECL(op), TCGOP_VECE(op),
+                       new_args, const_args);
+    } else {
+        tcg_out_op(s, op->opc, new_args, const_args);
+    }
+
+    if (keep && op->opc == INDEX_op_br) {
+        /* The code up to the next label is unreachable; the registers
+           of the label belong to the branch.  */
+        for (i = 0; i < keep->n; i++) {
+            temp_dead(s, keep->temps[i]);
+        }
+    } else if (keep) {
+        /* on the fall-through path of a conditional branch, the globals
+           are back in memory only, as the liveness analysis expects */
+        for (i = 0; i < keep->n; i++) {
+            temp_sync(s, keep->temps[i], i_allocated_regs, 1);
+        }
+    }
+
     /* move the outputs in the correct register if needed */
     for(i = 0; i < nb_oargs; i++) {
         ts = arg_temp(op->args[i]);
@@ -3174,6 +4079,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 
 #ifdef USE_TCG_OPTIMIZATIONS
     tcg_optimize(s);
+    label_regs_pass(s);
 #endif
 
 #ifdef CONFIG_PROFILER
@@ -3239,10 +4145,12 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
         switch (opc) {
         case INDEX_op_mov_i32:
         case INDEX_op_mov_i64:
+        case INDEX_op_mov_vec:
             tcg_reg_alloc_mov(s, op);
             break;
         case INDEX_op_movi_i32:
         case INDEX_op_movi_i64:
+        case INDEX_op_dupi_vec:
             tcg_reg_alloc_movi(s, op);
             break;
         case INDEX_op_insn_start:
@@ -3264,8 +4172,14 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             temp_dead(s, arg_temp(op->args[0]));
             break;
         case INDEX_op_set_label:
-            tcg_reg_alloc_bb_end(s, s->reserved_regs);
-            tcg_out_label(s, arg_label(op->args[0]), s->code_ptr);
+            {
+                TCGOp *prev = QTAILQ_PREV(op, TCGOpHead, link);
+                bool fallthrough = !(prev
+                                     && (prev->opc == INDEX_op_br
+                                         || prev->opc == INDEX_op_exit_tb
+                                         || prev->opc == INDEX_op_goto_ptr));
+                tcg_reg_alloc_label(s, arg_label(op->args[0]), fallthrough);
+            }
             break;
         case INDEX_op_call:
             tcg_reg_alloc_call(s, op);
@@ -3304,6 +4218,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
         return -1;
     }
 #endif
+#ifdef TCG_TARGET_NEED_SUPERINSNS
+    tcg_out_superinsns(s);
+#endif
 
     /* flush instruction cache */
     flush_icache_range((uintptr_t)s->code_buf, (uintptr_t)s->code_ptr);
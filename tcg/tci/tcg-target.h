@@ -43,6 +43,7 @@
 #define TCG_TARGET_INTERPRETER 1
 #define TCG_TARGET_INSN_UNIT_SIZE 1
 #define TCG_TARGET_TLB_DISPLACEMENT_BITS 32
+#define TCG_TARGET_IMPLEMENTS_DYN_TLB 1
 
 #if UINTPTR_MAX == UINT32_MAX
 # define TCG_TARGET_REG_BITS 32
@@ -185,6 +186,26 @@ typedef enum {
 #define TCG_TARGET_CALL_STACK_OFFSET    0
 #define TCG_TARGET_STACK_ALIGN          16
 
+/* Superinstructions: bytecode opcodes after the TCG ones, each standing
+   for a sequence of TCG ops which tcg_out_superinsns() fused so that the
+   interpreter dispatches them at once.  "ld", "st" and "add" are the ops
+   of the host register size, e.g. ld_i64 on 64 bit hosts. */
+typedef enum {
+    TCI_OP_FIRST = 0xf0,
+    TCI_OP_ld_ld = TCI_OP_FIRST,
+    TCI_OP_st_st,
+    TCI_OP_ld_st,
+    TCI_OP_st_ld,
+    TCI_OP_ld_add,
+    TCI_OP_add_st,
+    TCI_OP_ld_add_st,
+    TCI_OP_ld_brcond_i32,
+    TCI_OP_movi_st_i32,
+    TCI_OP_LAST
+} TCIOpcode;
+
+#define TCG_TARGET_NEED_SUPERINSNS
+
 void tci_disas(uint8_t opc);
 
 #define HAVE_TCG_QEMU_TB_EXEC
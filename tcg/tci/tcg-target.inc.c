@@ -851,6 +851,112 @@ static inline bool tcg_out_sti(TCGContext *s, TCGType type, TCGArg val,
     return false;
 }
 
+/* The host register sized ld, st and add ops. */
+#if TCG_TARGET_REG_BITS == 64
+# define TCI_OP_LD      INDEX_op_ld_i64
+# define TCI_OP_ST      INDEX_op_st_i64
+# define TCI_OP_ADD     INDEX_op_add_i64
+#else
+# define TCI_OP_LD      INDEX_op_ld_i32
+# define TCI_OP_ST      INDEX_op_st_i32
+# define TCI_OP_ADD     INDEX_op_add_i32
+#endif
+
+/* Superinstruction opcodes follow the TCG ones in the same byte. */
+QEMU_BUILD_BUG_ON((int)NB_OPS > (int)TCI_OP_FIRST);
+
+/* Sequences of ops fused into superinstructions, longest first.
+   Only ops which neither fault nor call out may be parts of one,
+   because the interpreter sets tci_tb_ptr just once for all of them. */
+static const struct {
+    uint8_t insn;
+    uint8_t nb_ops;
+    uint8_t ops[3];
+} tci_superinsns[] = {
+    { TCI_OP_ld_add_st, 3, { TCI_OP_LD, TCI_OP_ADD, TCI_OP_ST } },
+    { TCI_OP_ld_ld, 2, { TCI_OP_LD, TCI_OP_LD } },
+    { TCI_OP_st_st, 2, { TCI_OP_ST, TCI_OP_ST } },
+    { TCI_OP_ld_st, 2, { TCI_OP_LD, TCI_OP_ST } },
+    { TCI_OP_st_ld, 2, { TCI_OP_ST, TCI_OP_LD } },
+    { TCI_OP_ld_add, 2, { TCI_OP_LD, TCI_OP_ADD } },
+    { TCI_OP_add_st, 2, { TCI_OP_ADD, TCI_OP_ST } },
+    { TCI_OP_ld_brcond_i32, 2, { INDEX_op_ld_i32, INDEX_op_brcond_i32 } },
+    { TCI_OP_movi_st_i32, 2, { INDEX_op_movi_i32, INDEX_op_st_i32 } },
+};
+
+/* Mark the start of every op which is jumped to: label targets, and the
+   op following a goto_tb, where its unpatched jump goes. */
+static void tci_mark_targets(TCGContext *s, unsigned long *targets)
+{
+    uint8_t *start = s->code_buf;
+    size_t size = s->code_ptr - start;
+    uint8_t *p;
+
+    for (p = start; p < s->code_ptr; p += p[1]) {
+        tcg_target_ulong dest;
+
+        switch (p[0]) {
+        case INDEX_op_br:
+        case INDEX_op_brcond_i32:
+#if TCG_TARGET_REG_BITS == 32
+        case INDEX_op_brcond2_i32:
+#else
+        case INDEX_op_brcond_i64:
+#endif
+            /* The label is the last field of the op. */
+            dest = *(tcg_target_ulong *)(p + p[1] - sizeof(dest));
+            tcg_debug_assert(dest - (uintptr_t)start < size);
+            set_bit(dest - (uintptr_t)start, targets);
+            break;
+        case INDEX_op_goto_tb:
+            if (p + p[1] < s->code_ptr) {
+                set_bit(p + p[1] - start, targets);
+            }
+            break;
+        }
+    }
+}
+
+/* Fuse common sequences of ops into superinstructions, so that the
+   interpreter dispatches once for all of them.  Only the opcode and size
+   of the first op are rewritten; the others keep their own, which the
+   interpreter skips, so no code moves and no label or jump offset needs
+   updating.  No op but the first may be a jump target, of course. */
+static void tcg_out_superinsns(TCGContext *s)
+{
+    size_t size = s->code_ptr - s->code_buf;
+    unsigned long *targets;
+    uint8_t *p;
+
+    targets = tcg_malloc(BITS_TO_LONGS(size) * sizeof(unsigned long));
+    memset(targets, 0, BITS_TO_LONGS(size) * sizeof(unsigned long));
+    tci_mark_targets(s, targets);
+
+    for (p = s->code_buf; p < s->code_ptr; p += p[1]) {
+        size_t i;
+
+        for (i = 0; i < ARRAY_SIZE(tci_superinsns); i++) {
+            uint8_t *q = p;
+            unsigned len = 0;
+            int j;
+
+            for (j = 0; j < tci_superinsns[i].nb_ops; j++) {
+                if (q >= s->code_ptr || q[0] != tci_superinsns[i].ops[j]
+                    || (j && test_bit(q - s->code_buf, targets))) {
+                    break;
+                }
+                len += q[1];
+                q += q[1];
+            }
+            if (j == tci_superinsns[i].nb_ops && len <= UINT8_MAX) {
+                p[0] = tci_superinsns[i].insn;
+                p[1] = len;
+                break;
+            }
+        }
+    }
+}
+
 /* Test if a constant matches the constraint. */
 static int tcg_target_const_match(tcg_target_long val, TCGType type,
                                   const TCGArgConstraint *arg_ct)
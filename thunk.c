@@ -60,6 +60,34 @@ static const argtype *thunk_type_next_ptr(const argtype *type_ptr)
     return thunk_type_next(type_ptr);
 }
 
+/* Return true if converting the type is a plain copy, i.e. it has the
+   same size and byte order on the target and on the host.  */
+static bool thunk_type_same_layout(const argtype *type_ptr)
+{
+    switch (*type_ptr) {
+    case TYPE_CHAR:
+        return true;
+#ifndef BSWAP_NEEDED
+    case TYPE_SHORT:
+    case TYPE_INT:
+    case TYPE_LONGLONG:
+    case TYPE_ULONGLONG:
+        return true;
+    case TYPE_LONG:
+    case TYPE_ULONG:
+    case TYPE_PTRVOID:
+    case TYPE_OLDDEVT:
+        return thunk_type_size(type_ptr, 0) == thunk_type_size(type_ptr, 1);
+#endif
+    case TYPE_ARRAY:
+        return thunk_type_same_layout(type_ptr + 2);
+    case TYPE_STRUCT:
+        return struct_entries[type_ptr[1]].same_layout;
+    default:
+        return false;
+    }
+}
+
 void thunk_register_struct(int id, const char *name, const argtype *types)
 {
     const argtype *type_ptr;
@@ -109,6 +137,15 @@ void thunk_register_struct(int id, const char *name, const argtype *types)
                i == THUNK_HOST ? "host" : "target", offset, max_align);
 #endif
     }
+
+    /* Nested structs are registered first, so their flag is known.  */
+    se->same_layout = se->size[0] == se->size[1];
+    type_ptr = se->field_types;
+    for (j = 0; j < nb_fields && se->same_layout; j++) {
+        se->same_layout = se->field_offsets[0][j] == se->field_offsets[1][j]
+                          && thunk_type_same_layout(type_ptr);
+        type_ptr = thunk_type_next(type_ptr);
+    }
 }
 
 void thunk_register_struct_direct(int id, const char *name,
@@ -227,10 +264,14 @@ const argtype *thunk_convert(void *dst, const void *src,
             src_size = thunk_type_size(type_ptr, 1 - to_host);
             d = dst;
             s = src;
-            for(i = 0;i < array_length; i++) {
-                thunk_convert(d, s, type_ptr, to_host);
-                d += dst_size;
-                s += src_size;
+            if (thunk_type_same_layout(type_ptr)) {
+                memcpy(d, s, array_length * dst_size);
+            } else {
+                for (i = 0; i < array_length; i++) {
+                    thunk_convert(d, s, type_ptr, to_host);
+                    d += dst_size;
+                    s += src_size;
+                }
             }
             type_ptr = thunk_type_next(type_ptr);
         }
@@ -246,7 +287,9 @@ const argtype *thunk_convert(void *dst, const void *src,
 
             assert(*type_ptr < max_struct_entries);
             se = struct_entries + *type_ptr++;
-            if (se->convert[0] != NULL) {
+            if (se->same_layout) {
+                memcpy(dst, src, se->size[to_host]);
+            } else if (se->convert[0] != NULL) {
                 /* specific conversion is needed */
                 (*se->convert[to_host])(dst, src);
             } else {
@@ -272,6 +272,13 @@ const QEMULogItem qemu_log_items[] = {
     { CPU_LOG_TB_NOCHAIN, "nochain",
       "do not chain compiled TBs so that \"exec\" and \"cpu\" show\n"
       "complete traces" },
+    { CPU_LOG_TB_HOT, "hot_tbs",
+      "count TB executions and report the most executed TBs" },
+    { CPU_LOG_INSN_STATS, "insn_stats",
+      "count translated instructions, TCG ops and host code per\n"
+      "instruction class; see \"info opcount\"" },
+    { CPU_LOG_INSN_EXEC, "insn_exec",
+      "like insn_stats, and also count instruction executions" },
     { 0, NULL, NULL },
 };
 
@@ -1,177 +1,150 @@
 /* Code to mangle pathnames into those matching a given prefix.
    eg. open("/lib/foo.so") => open("/usr/gnemul/i386-linux/lib/foo.so");
 
-   The assumption is that this area does not change.
+   Names are looked up in the prefix the first time they are used, and
+   the result, positive or negative, is cached.  The assumption is that
+   this area does not change.  "." and ".." are resolved textually, as
+   if the prefix were the root directory.
 */
 #include "qemu/osdep.h"
-#include <sys/param.h>
-#include <dirent.h>
 #include "qemu/cutils.h"
 #include "qemu/path.h"
+#include "qemu/thread.h"
 
-struct pathelem
-{
-    /* Name of this, eg. lib */
-    char *name;
-    /* Full path name, eg. /usr/gnemul/x86-linux/lib. */
-    char *pathname;
-    struct pathelem *parent;
-    /* Children */
-    unsigned int num_entries;
-    struct pathelem *entries[0];
-};
-
-static struct pathelem *base;
-
-/* First N chars of S1 match S2, and S2 is N chars long. */
-static int strneq(const char *s1, unsigned int n, const char *s2)
-{
-    unsigned int i;
-
-    for (i = 0; i < n; i++)
-        if (s1[i] != s2[i])
-            return 0;
-    return s2[i] == 0;
-}
+/* Positive entries are bounded by the contents of the prefix, but any
+   number of names may be missing from it; drop the negative entries
+   when there are this many.  */
+#define PATH_MAX_NEGATIVE 4096
 
-static struct pathelem *add_entry(struct pathelem *root, const char *name,
-                                  unsigned type);
+static char *base;
+static GHashTable *hash;
+static unsigned int n_negative;
+static QemuMutex lock;
 
-static struct pathelem *new_entry(const char *root,
-                                  struct pathelem *parent,
-                                  const char *name)
+void init_paths(const char *prefix)
 {
-    struct pathelem *new = g_malloc(sizeof(*new));
-    new->name = g_strdup(name);
-    new->pathname = g_strdup_printf("%s/%s", root, name);
-    new->num_entries = 0;
-    return new;
-}
+    struct stat st;
 
-#define streq(a,b) (strcmp((a), (b)) == 0)
-
-/* Not all systems provide this feature */
-#if defined(DT_DIR) && defined(DT_UNKNOWN) && defined(DT_LNK)
-# define dirent_type(dirent) ((dirent)->d_type)
-# define is_dir_maybe(type) \
-    ((type) == DT_DIR || (type) == DT_UNKNOWN || (type) == DT_LNK)
-#else
-# define dirent_type(dirent) (1)
-# define is_dir_maybe(type)  (type)
-#endif
+    if (prefix[0] == '\0' ||
+        !strcmp(prefix, "/")) {
+        return;
+    }
 
-static struct pathelem *add_dir_maybe(struct pathelem *path)
-{
-    DIR *dir;
+    if (prefix[0] != '/') {
+        char *cwd = g_get_current_dir();
 
-    if ((dir = opendir(path->pathname)) != NULL) {
-        struct dirent *dirent;
+        base = g_build_filename(cwd, prefix, NULL);
+        g_free(cwd);
+    } else {
+        base = g_strdup(prefix);
+    }
 
-        while ((dirent = readdir(dir)) != NULL) {
-            if (!streq(dirent->d_name,".") && !streq(dirent->d_name,"..")){
-                path = add_entry(path, dirent->d_name, dirent_type(dirent));
-            }
-        }
-        closedir(dir);
+    if (stat(base, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        g_free(base);
+        base = NULL;
+        return;
     }
-    return path;
+
+    hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    qemu_mutex_init(&lock);
 }
 
-static struct pathelem *add_entry(struct pathelem *root, const char *name,
-                                  unsigned type)
+/* Return a copy of the absolute NAME without empty and "." components,
+   and with each ".." removing the component before it.  */
+static char *normalize(const char *name)
 {
-    struct pathelem **e;
+    char *norm = g_malloc(strlen(name) + 2);
+    char *p = norm;
 
-    root->num_entries++;
+    while (*name) {
+        const char *end;
+        size_t len;
 
-    root = g_realloc(root, sizeof(*root)
-                   + sizeof(root->entries[0])*root->num_entries);
-    e = &root->entries[root->num_entries-1];
+        while (*name == '/') {
+            name++;
+        }
+        end = strchr(name, '/');
+        len = end ? end - name : strlen(name);
 
-    *e = new_entry(root->pathname, root, name);
-    if (is_dir_maybe(type)) {
-        *e = add_dir_maybe(*e);
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            while (p > norm && *--p != '/') {
+                continue;
+            }
+        } else if (len > 0 && !(len == 1 && name[0] == '.')) {
+            *p++ = '/';
+            memcpy(p, name, len);
+            p += len;
+        }
+        name += len;
     }
-
-    return root;
+    if (p == norm) {
+        *p++ = '/';
+    }
+    *p = '\0';
+    return norm;
 }
 
-/* This needs to be done after tree is stabilized (ie. no more reallocs!). */
-static void set_parents(struct pathelem *child, struct pathelem *parent)
+static gboolean is_negative(gpointer key, gpointer value, gpointer opaque)
 {
-    unsigned int i;
-
-    child->parent = parent;
-    for (i = 0; i < child->num_entries; i++)
-        set_parents(child->entries[i], child);
+    return value == NULL;
 }
 
-/* FIXME: Doesn't handle DIR/.. where DIR is not in emulated dir. */
-static const char *
-follow_path(const struct pathelem *cursor, const char *name)
+/* Return the name of NAME inside the prefix, or NULL if it does not
+   exist there.  The directory of NAME is looked up first, so that a
+   subtree missing from the prefix (say /proc or /home) costs a single
+   access() however many names below it are used; names below such a
+   directory are not cached themselves.  Called with the lock held. */
+static const char *lookup(const char *name)
 {
-    unsigned int i, namelen;
-
-    name += strspn(name, "/");
-    namelen = strcspn(name, "/");
-
-    if (namelen == 0)
-        return cursor->pathname;
-
-    if (strneq(name, namelen, ".."))
-        return follow_path(cursor->parent, name + namelen);
-
-    if (strneq(name, namelen, "."))
-        return follow_path(cursor, name + namelen);
+    gpointer key, value;
+    const char *slash;
+    char *full;
 
-    for (i = 0; i < cursor->num_entries; i++)
-        if (strneq(name, namelen, cursor->entries[i]->name))
-            return follow_path(cursor->entries[i], name + namelen);
-
-    /* Not found */
-    return NULL;
-}
+    if (g_hash_table_lookup_extended(hash, name, &key, &value)) {
+        return value;
+    }
 
-void init_paths(const char *prefix)
-{
-    char pref_buf[PATH_MAX];
+    slash = strrchr(name, '/');
+    if (slash != name) {
+        char *dir = g_strndup(name, slash - name);
+        bool dir_found = lookup(dir) != NULL;
 
-    if (prefix[0] == '\0' ||
-        !strcmp(prefix, "/"))
-        return;
+        g_free(dir);
+        if (!dir_found) {
+            return NULL;
+        }
+    }
 
-    if (prefix[0] != '/') {
-        char *cwd = getcwd(NULL, 0);
-        size_t pref_buf_len = sizeof(pref_buf);
-
-        if (!cwd)
-            abort();
-        pstrcpy(pref_buf, sizeof(pref_buf), cwd);
-        pstrcat(pref_buf, pref_buf_len, "/");
-        pstrcat(pref_buf, pref_buf_len, prefix);
-        free(cwd);
-    } else
-        pstrcpy(pref_buf, sizeof(pref_buf), prefix + 1);
-
-    base = new_entry("", NULL, pref_buf);
-    base = add_dir_maybe(base);
-    if (base->num_entries == 0) {
-        g_free(base->pathname);
-        g_free(base->name);
-        g_free(base);
-        base = NULL;
-    } else {
-        set_parents(base, base);
+    full = g_strconcat(base, name, NULL);
+    if (access(full, F_OK) != 0) {
+        g_free(full);
+        full = NULL;
+        if (++n_negative > PATH_MAX_NEGATIVE) {
+            g_hash_table_foreach_remove(hash, is_negative, NULL);
+            n_negative = 1;
+        }
     }
+
+    g_hash_table_insert(hash, g_strdup(name), full);
+    return full;
 }
 
 /* Look for path in emulation dir, otherwise return name. */
 const char *path(const char *name)
 {
+    const char *ret;
+    char *norm;
+
     /* Only do absolute paths: quick and dirty, but should mostly be OK.
        Could do relative by tracking cwd. */
     if (!base || !name || name[0] != '/')
         return name;
 
-    return follow_path(base, name) ?: name;
+    norm = normalize(name);
+    qemu_mutex_lock(&lock);
+    ret = lookup(norm);
+    qemu_mutex_unlock(&lock);
+    g_free(norm);
+
+    return ret ?: name;
 }
@@ -127,6 +127,7 @@ int main(int argc, char **argv)
 #include "sysemu/replay.h"
 #include "qapi/qmp/qerror.h"
 #include "sysemu/iothread.h"
+#include "perf.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 #define MAX_SCLP_CONSOLES 1
@@ -334,6 +335,16 @@ static QemuOptsList qemu_accel_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Enable/disable multi-threaded TCG",
         },
+        {
+            .name = "evict",
+            .type = QEMU_OPT_BOOL,
+            .help = "Evict translations one region at a time",
+        },
+        {
+            .name = "hugepages",
+            .type = QEMU_OPT_BOOL,
+            .help = "Align the translation buffer for huge pages",
+        },
         { /* end of list */ }
     },
 };
@@ -3412,6 +3423,14 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_singlestep:
                 singlestep = 1;
                 break;
+#ifdef CONFIG_TCG
+            case QEMU_OPTION_perfmap:
+                perf_enable_perfmap();
+                break;
+            case QEMU_OPTION_jitdump:
+                perf_enable_jitdump();
+                break;
+#endif
             case QEMU_OPTION_S:
                 autostart = 0;
                 break;
@@ -4767,6 +4786,9 @@ int main(int argc, char **argv, char **envp)
     main_loop();
     replay_disable_events();
     iothread_stop_all();
+#ifdef CONFIG_TCG
+    perf_exit();
+#endif
 
     pause_all_vcpus();
     bdrv_close_all();